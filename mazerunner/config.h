@@ -71,6 +71,8 @@ const float ROTATION_BIAS = 0.0025; // Negative makes robot curve to left
 // This is the size fo each cell in the maze. Normally 180mm for a classic maze
 const float FULL_CELL = 180.0f;
 const float HALF_CELL = FULL_CELL / 2.0;
+// the distance between the corners of a zig-zag on a diagonal
+const float DIAGONAL_STEP = HALF_CELL * 1.41421356f;
 
 //***************************************************************************//
 // Battery resistor bridge //Derek Hall//
@@ -114,6 +116,19 @@ const float FWD_KD = 1.1;
 const float ROT_KP = 2.1;
 const float ROT_KD = 1.2;
 
+// Set this to 1 to use jerk limited S-curve profiles for forward and
+// rotation motion. The acceleration then ramps up and down rather than
+// changing in one step. Note that the speed run turns are worked out for
+// the plain trapezoidal profiles.
+#define USE_SCURVE_PROFILES 0
+const float FWD_JERK = 60000; // mm/s/s/s
+const float ROT_JERK = 200000; // deg/s/s/s
+
+// Set this to 1 to do the systick control sums in Q16.16 fixed point rather
+// than with floats. Fixed point is much faster on the ATmega328, which has
+// no floating point hardware. S-curve profiles need floats.
+#define USE_FIXED_POINT_CONTROL 0
+
 // controller constants for the steering controller
 const float STEERING_KP = 0.25;
 const float STEERING_KD = 0.00;
@@ -142,6 +157,15 @@ const float BIAS_FF = (23.0 / 280.0);
 // encoder polarity is set to account for reversal of the encoder phases
 const int ENCODER_LEFT_POLARITY = (-1);
 const int ENCODER_RIGHT_POLARITY = (1);
+// Set this to 1 to blend the speed from the time between encoder edges
+// into the feedback at low speeds. It adds a timer read to every encoder
+// interrupt. Compare the two with test 28 before turning it on.
+#define ENCODER_EDGE_TIMING 0
+// Below this many counts per tick, the wheel speeds come mostly from the
+// time between encoder edges rather than from the counts in each tick.
+const int ENCODER_BLEND_COUNTS = 4;
+// With no edge for this long, a wheel is taken to have stopped (ms, < 500)
+const int ENCODER_IDLE_TIME = 250;
 
 // similarly, the motors may be wired with different polarity and that
 // is defined here so that setting a positive voltage always moves the robot
@@ -184,6 +208,27 @@ const int LEFT_THRESHOLD = 40;   // minimum value to register a wall
 const int FRONT_THRESHOLD = 20;  // minimum value to register a wall
 const int RIGHT_THRESHOLD = 40;  // minimum value to register a wall
 const int FRONT_REFERENCE = 850; // reading when mouse centered with wall ahead
+// on a diagonal, side readings above these mean a post is too close
+const int LEFT_DIAGONAL_THRESHOLD = 60;
+const int RIGHT_DIAGONAL_THRESHOLD = 60;
+
+// Wall edges are found where a side reading crosses half its nominal value.
+// The positions are mm past the cell boundary behind the robot when that
+// happens. Falling is a wall ending, rising is a wall starting. Run test 20
+// to measure them. The values below are only placeholders so the edges are
+// just recorded. Set WALL_EDGE_CORRECTION to 1 once they are calibrated.
+// Until then there is no forward correction at all: the detector runs but
+// the odometry error over a long straight is not taken out.
+#define WALL_EDGE_CORRECTION 0
+const int EDGE_HYSTERESIS = 5;
+const float LEFT_FALLING_EDGE = 130;
+const float LEFT_RISING_EDGE = 130;
+const float RIGHT_FALLING_EDGE = 130;
+const float RIGHT_RISING_EDGE = 130;
+// edges further than this from where they should be are ignored (mm)
+const float EDGE_WINDOW = 25;
+// and so are edges seen with the robot more than this off its heading (deg)
+const float EDGE_ANGLE_LIMIT = 5;
 //***************************************************************************//
 //***************************************************************************//
 // Some physical constants that are likely to be board -specific
@@ -194,8 +239,14 @@ const int BACK_WALL_TO_CENTER = 48;
 //***************************************************************************//
 
 // Control loop timing. Pre-calculate to save time in interrupts
-const float LOOP_FREQUENCY = 500.0;
+// Timer 2 counts at F_CPU/128 (125kHz) and systick divides that by at most
+// 256 so LOOP_FREQUENCY must divide 125000 exactly and be at least 489Hz.
+// 500Hz and 1000Hz are the sensible choices. The controller KD gains act
+// on the change in error per tick so they need retuning if this changes.
+const uint16_t LOOP_FREQUENCY = 500;
 const float LOOP_INTERVAL = (1.0 / LOOP_FREQUENCY);
+// the battery monitor and switch sampling only need to run at this rate
+const uint16_t SLOW_TASK_FREQUENCY = 50;
 
 //***************************************************************************//
 // change the revision if the settings structure changes to force rewrte of EEPROM
@@ -209,6 +260,10 @@ const int EEPROM_ADDR_SETTINGS = 0x0000;
 #define DEBUG_LOGGING 0
 // time between logged lined when reporting is enabled (milliseconds)
 const int REPORTING_INTERVAL = 10;
+// set this to 1 to time systick and the other interrupts. See timing.h
+// It adds work to every interrupt, including each encoder edge, so it is
+// off for normal running.
+#define ISR_TIMING 0
 
 //***************************************************************************//
 const float MAX_MOTOR_VOLTS = 6.0;
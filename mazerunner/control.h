@@ -0,0 +1,112 @@
+/*
+ * File: control.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:40:01 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:51:19 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "config.h"
+#include "fixed.h"
+#include <Arduino.h>
+
+/***
+ * These are the sums that systick does for the encoders, the wall sensors,
+ * the steering and the motor controllers. They are templates so that the
+ * float and fixed point builds share the same code. Test 25 runs both
+ * versions side by side on the same inputs to check that they agree.
+ *
+ * The modules call them with a control_t. See fixed.h.
+ */
+
+const float MM_PER_COUNT = PI * WHEEL_DIAMETER / (ENCODER_PULSES * GEAR_RATIO);
+const float MM_PER_COUNT_LEFT = (1 - ROTATION_BIAS) * MM_PER_COUNT;
+const float MM_PER_COUNT_RIGHT = (1 + ROTATION_BIAS) * MM_PER_COUNT;
+const float DEG_PER_MM_DIFFERENCE = (180.0 / (2 * MOUSE_RADIUS * PI));
+
+/***
+ * @brief convert wheel encoder counts into forward (mm) and rotary (deg) changes
+ */
+template <typename T>
+inline void get_wheel_increments(T left_delta, T right_delta, T &fwd, T &rot) {
+  T left_change = left_delta * T(MM_PER_COUNT_LEFT);
+  T right_change = right_delta * T(MM_PER_COUNT_RIGHT);
+  fwd = T(0.5f) * (right_change + left_change);
+  rot = (right_change - left_change) * T(DEG_PER_MM_DIFFERENCE);
+}
+
+/***
+ * @brief the output of a PD controller from the error and its previous value
+ */
+template <typename T>
+inline T get_pd_output(T error, T old_error, T kp, T kd) {
+  return kp * error + kd * (error - old_error);
+}
+
+/***
+ * The speed feedforward uses the per-tick profile increments rather than
+ * the profile speeds so that only the increments have to be passed around.
+ *
+ * @brief get the feedforward drive for each wheel in volts
+ */
+template <typename T>
+inline void get_feedforward(T fwd_increment, T rot_increment, T &left, T &right) {
+  T tangent = T((PI / 180.0f) * MOUSE_RADIUS) * rot_increment;
+  left = T(SPEED_FF * LOOP_FREQUENCY) * (fwd_increment - tangent);
+  right = T(SPEED_FF * LOOP_FREQUENCY) * (fwd_increment + tangent);
+}
+
+/***
+ * @brief limit the volts to the motor supply and scale them to a PWM value
+ */
+template <typename T>
+inline int get_motor_pwm(T volts, T battery_scale) {
+  volts = constrain(volts, T(-MAX_MOTOR_VOLTS), T(MAX_MOTOR_VOLTS));
+  return to_int(volts * battery_scale);
+}
+
+/***
+ * @brief normalise a raw wall sensor reading to a nominal value of 100
+ */
+template <typename T>
+inline int get_normalised_sensor(int raw, T adjust) {
+  return to_int(raw * adjust);
+}
+
+/***
+ * @brief the steering adjustment in degrees for one tick
+ */
+template <typename T>
+inline T get_steering_adjustment(T error, T last_error, T kp, T kd) {
+  T adjustment = per_tick(get_pd_output(error, last_error, kp, kd));
+  return constrain(adjustment, T(-STEERING_ADJUST_LIMIT), T(STEERING_ADJUST_LIMIT));
+}
+
+#endif
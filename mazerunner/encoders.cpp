@@ -31,8 +31,11 @@
  */
 
 #include "encoders.h"
+#include "control.h"
 #include "digitalWriteFast.h"
 #include "settings.h"
+#include "systick.h"
+#include "timing.h"
 #include <Arduino.h>
 #include <util/atomic.h>
 /****************************************************************************/
@@ -78,35 +81,60 @@
 
 */
 
-const float MM_PER_COUNT_LEFT = (1 - ROTATION_BIAS) * PI * WHEEL_DIAMETER / (ENCODER_PULSES * GEAR_RATIO);
-const float MM_PER_COUNT_RIGHT = (1 + ROTATION_BIAS) * PI * WHEEL_DIAMETER / (ENCODER_PULSES * GEAR_RATIO);
-const float DEG_PER_MM_DIFFERENCE = (180.0 / (2 * MOUSE_RADIUS * PI));
-
-static volatile float s_robot_position;
-static volatile float s_robot_angle;
-
-static float s_robot_fwd_increment = 0;
-static float s_robot_rot_increment = 0;
+static control_t s_robot_fwd_increment = 0;
+static control_t s_robot_rot_increment = 0;
 
 int encoder_left_counter;
 int encoder_right_counter;
 
+/***
+ * The odometry is kept as whole counts. Sums of integers do not lose
+ * anything however far the robot goes, and they only get turned into mm
+ * and degrees when something asks for them.
+ */
 static volatile int32_t s_left_total;
 static volatile int32_t s_right_total;
 
 static volatile int left_delta;
 static volatile int right_delta;
 
+/***
+ * The encoder interrupts timestamp every edge. These are only read inside
+ * the ATOMIC_BLOCK in update_encoders().
+ */
+struct EdgeTiming {
+  uint16_t time;     // systick_time() of the last edge
+  uint16_t period;   // time between the last two edges, zero if unknown
+  int8_t direction;  // of the last edge, +1 or -1
+};
+
+struct WheelEstimate {
+  control_t speed;    // counts per tick
+  control_t offset;   // estimated movement since the last edge, in counts
+  uint8_t idle_ticks; // since the last edge
+};
+
+static EdgeTiming s_left_edge;
+static EdgeTiming s_right_edge;
+static WheelEstimate s_left_wheel;
+static WheelEstimate s_right_wheel;
+
+const uint8_t ENCODER_IDLE_TICKS = (uint32_t)ENCODER_IDLE_TIME * LOOP_FREQUENCY / 1000;
+static_assert(ENCODER_IDLE_TIME < 500, "edge timestamps wrap after 524ms");
+static_assert((uint32_t)ENCODER_IDLE_TIME * LOOP_FREQUENCY / 1000 < 256, "idle_ticks is only 8 bits");
+
 void reset_encoders() {
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
     encoder_left_counter = 0;
     encoder_right_counter = 0;
-    s_robot_position = 0;
-    s_robot_angle = 0;
     s_left_total = 0;
     s_right_total = 0;
     left_delta = 0;
     right_delta = 0;
+    s_left_edge = EdgeTiming();
+    s_right_edge = EdgeTiming();
+    s_left_wheel = WheelEstimate();
+    s_right_wheel = WheelEstimate();
   }
 }
 
@@ -135,56 +163,157 @@ void setup_encoders() {
   reset_encoders();
 }
 
+/***
+ * At low speeds there are only a few counts in each tick, or none at all,
+ * so counting alone gives very lumpy feedback. The time between the last
+ * two edges gives a much better speed once there is less than about one
+ * count per tick. The two are blended with the count-based speed taking
+ * over as the speed goes up. The time since the last edge puts an upper
+ * limit on the edge speed so that it falls away when a wheel stops.
+ *
+ * The speed is used to estimate how far the wheel has gone since its last
+ * edge. That offset is never more than one count, and goes back to zero
+ * once the wheel stops, so the feedback can never drift away from the counts.
+ *
+ * @brief return the movement of a wheel in counts, including any fraction
+ */
+static control_t update_wheel(WheelEstimate &wheel, int delta, const EdgeTiming &edge, uint16_t now) {
+  if (delta != 0) {
+    wheel.idle_ticks = 0;
+  } else if (wheel.idle_ticks < ENCODER_IDLE_TICKS) {
+    wheel.idle_ticks++;
+  }
+  control_t speed = delta;
+  if (wheel.idle_ticks >= ENCODER_IDLE_TICKS) {
+    speed = 0;
+  } else if (edge.period != 0 && abs(delta) < ENCODER_BLEND_COUNTS) {
+    uint16_t since_edge = now - edge.time;
+    uint16_t interval = max(edge.period, since_edge);
+    control_t edge_speed = control_t((int)SYSTICK_COUNTS) / (int32_t)interval;
+    control_t weight = min(edge_speed * control_t(1.0f / ENCODER_BLEND_COUNTS), control_t(1));
+    speed = weight * delta + (control_t(1) - weight) * (edge.direction * edge_speed);
+  }
+  control_t step = fabsf(speed);
+  control_t offset;
+  if (delta != 0) {
+    // the last edge was during this tick
+    offset = step * (int)(uint16_t)(now - edge.time) * control_t(1.0f / SYSTICK_COUNTS);
+  } else {
+    offset = fabsf(wheel.offset) + step;
+  }
+  if (wheel.idle_ticks >= ENCODER_IDLE_TICKS) {
+    // the wheel has stopped so go back to the counts
+    offset = 0;
+  }
+  offset = edge.direction * min(offset, control_t(1));
+  control_t change = delta + offset - wheel.offset;
+  wheel.offset = offset;
+  wheel.speed = speed;
+  return change;
+}
+
 // units are all in counts and counts per second
 void update_encoders() {
-
+  EdgeTiming left_edge;
+  EdgeTiming right_edge;
+  uint16_t now = 0;
   // Make sure values don't change while being read. Be quick.
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
     left_delta = encoder_left_counter;
     right_delta = encoder_right_counter;
     encoder_left_counter = 0;
     encoder_right_counter = 0;
+    if (ENCODER_EDGE_TIMING) {
+      left_edge = s_left_edge;
+      right_edge = s_right_edge;
+      now = systick_time();
+    }
   }
   s_left_total += left_delta;
   s_right_total += right_delta;
-  float left_change = left_delta * MM_PER_COUNT_LEFT;
-  float right_change = right_delta * MM_PER_COUNT_RIGHT;
-  s_robot_fwd_increment = 0.5 * (right_change + left_change);
-  s_robot_rot_increment = (right_change - left_change) * DEG_PER_MM_DIFFERENCE;
-  s_robot_position += s_robot_fwd_increment;
-  s_robot_angle += s_robot_rot_increment;
+  control_t left_change = left_delta;
+  control_t right_change = right_delta;
+  if (ENCODER_EDGE_TIMING) {
+    left_change = update_wheel(s_left_wheel, left_delta, left_edge, now);
+    right_change = update_wheel(s_right_wheel, right_delta, right_edge, now);
+  }
+  get_wheel_increments(left_change, right_change, s_robot_fwd_increment, s_robot_rot_increment);
 }
 
+static void get_totals(int32_t &left, int32_t &right) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    left = s_left_total;
+    right = s_right_total;
+  }
+}
+
+/***
+ * The position and angle are worked out from the encoder totals when they
+ * are asked for. That keeps the float sums out of systick. They follow the
+ * counts so they do not include the fraction of a count that the edge
+ * timing adds to the controller feedback.
+ *
+ * The sum and difference of the totals are exact so the angle does not
+ * come from subtracting two large floats, however far the robot has gone.
+ */
 float robot_position() {
-  float distance;
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { distance = s_robot_position; }
-  return distance;
+  int32_t left;
+  int32_t right;
+  get_totals(left, right);
+  int32_t sum = right + left;
+  int32_t difference = right - left;
+  return 0.5f * MM_PER_COUNT * (sum + difference * ROTATION_BIAS);
 }
 
-float robot_fwd_increment() {
-  float distance;
+control_t robot_fwd_increment() {
+  control_t distance;
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { distance = s_robot_fwd_increment; }
   return distance;
 }
 
-float robot_rot_increment() {
-  float distance;
+/***
+ * The feedback can include a fraction of a count from the edge timing.
+ * This is the forward increment from the whole counts alone.
+ *
+ * @brief return the forward movement in the last tick from the counts (mm)
+ */
+float robot_counted_fwd_increment() {
+  int left;
+  int right;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    left = left_delta;
+    right = right_delta;
+  }
+  return 0.5f * (left * MM_PER_COUNT_LEFT + right * MM_PER_COUNT_RIGHT);
+}
+
+control_t robot_rot_increment() {
+  control_t distance;
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { distance = s_robot_rot_increment; }
   return distance;
 }
 
 float robot_angle() {
-  float angle;
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { angle = s_robot_angle; }
-  return angle;
+  int32_t left;
+  int32_t right;
+  get_totals(left, right);
+  int32_t sum = right + left;
+  int32_t difference = right - left;
+  return MM_PER_COUNT * DEG_PER_MM_DIFFERENCE * (difference + sum * ROTATION_BIAS);
 }
 
 uint32_t encoder_left_total() {
-  return s_left_total;
+  int32_t left;
+  int32_t right;
+  get_totals(left, right);
+  return left;
 };
 
 uint32_t encoder_right_total() {
-  return s_right_total;
+  int32_t left;
+  int32_t right;
+  get_totals(left, right);
+  return right;
 };
 
 /**
@@ -192,30 +321,48 @@ uint32_t encoder_right_total() {
  * the encoder interrupts is less than 3% of the available bandwidth.
  */
 
-// INT0 will respond to the XOR-ed pulse train from the leftencoder
-// runs in constant time of around 3us per interrupt.
-// would be faster with direct port access
+/***
+ * Only used when ENCODER_EDGE_TIMING is set.
+ *
+ * @brief timestamp an encoder edge for update_wheel()
+ */
+static inline void record_edge(EdgeTiming &edge, int8_t direction) {
+  if (not ENCODER_EDGE_TIMING or direction == 0) {
+    return;
+  }
+  uint16_t now = systick_time();
+  edge.period = (direction == edge.direction) ? now - edge.time : 0;
+  edge.time = now;
+  edge.direction = direction;
+}
+
+/***
+ * All four encoder pins are on port D so each interrupt reads them all
+ * with a single read of PIND.
+ */
+static_assert(ENCODER_LEFT_CLK < 8 && ENCODER_LEFT_B < 8, "left encoder pins must be on port D");
+static_assert(ENCODER_RIGHT_CLK < 8 && ENCODER_RIGHT_B < 8, "right encoder pins must be on port D");
+
+// INT0 will respond to the XOR-ed pulse train from the left encoder
+// runs in constant time. See the I command for the actual time.
 ISR(INT0_vect) {
-  static bool oldA = false;
-  static bool oldB = false;
-  bool newB = digitalReadFast(ENCODER_LEFT_B);
-  bool newA = digitalReadFast(ENCODER_LEFT_CLK) ^ newB;
-  int delta = ENCODER_LEFT_POLARITY * ((oldA ^ newB) - (newA ^ oldB));
-  encoder_left_counter += delta;
-  oldA = newA;
-  oldB = newB;
+  uint8_t start = timing_start();
+  static uint8_t state = 0;
+  uint8_t pins = PIND;
+  int8_t delta = decode_quadrature(state, (pins >> ENCODER_LEFT_CLK) & 1, (pins >> ENCODER_LEFT_B) & 1);
+  encoder_left_counter += ENCODER_LEFT_POLARITY * delta;
+  record_edge(s_left_edge, ENCODER_LEFT_POLARITY * delta);
+  timing_stop(TIME_ENCODER_ISR, start);
 }
 
 // INT1 will respond to the XOR-ed pulse train from the right encoder
-// runs in constant time of around 3us per interrupt.
-// would be faster with direct port access
+// runs in constant time. See the I command for the actual time.
 ISR(INT1_vect) {
-  static bool oldA = false;
-  static bool oldB = false;
-  bool newB = digitalReadFast(ENCODER_RIGHT_B);
-  bool newA = digitalReadFast(ENCODER_RIGHT_CLK) ^ newB;
-  int delta = ENCODER_RIGHT_POLARITY * ((oldA ^ newB) - (newA ^ oldB));
-  encoder_right_counter += delta;
-  oldA = newA;
-  oldB = newB;
+  uint8_t start = timing_start();
+  static uint8_t state = 0;
+  uint8_t pins = PIND;
+  int8_t delta = decode_quadrature(state, (pins >> ENCODER_RIGHT_CLK) & 1, (pins >> ENCODER_RIGHT_B) & 1);
+  encoder_right_counter += ENCODER_RIGHT_POLARITY * delta;
+  record_edge(s_right_edge, ENCODER_RIGHT_POLARITY * delta);
+  timing_stop(TIME_ENCODER_ISR, start);
 }
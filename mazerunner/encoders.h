@@ -33,8 +33,32 @@
 #ifndef ENCODERS_H
 #define ENCODERS_H
 
+#include "fixed.h"
+#include <avr/pgmspace.h>
 #include <stdint.h>
 
+/***
+ * Each encoder interrupt is triggered by a change in the XOR of the A and
+ * B channels. That is the clock pin. The B channel has its own pin and A
+ * is the clock XOR B.
+ *
+ * The step is looked up from the previous and current A and B levels. The
+ * table index has the old A and B in bits 3 and 2 and the new A and B in
+ * bits 1 and 0. A change on both channels at once means an edge was missed
+ * so it counts as no movement.
+ */
+const int8_t QUADRATURE_STEPS[16] PROGMEM = {
+    0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0,
+};
+
+/***
+ * @brief update the encoder state from the clock and B levels (0 or 1) and return the step
+ */
+inline int8_t decode_quadrature(uint8_t &state, uint8_t clk, uint8_t b) {
+  state = ((state << 2) | ((clk ^ b) << 1) | b) & 0x0F;
+  return (int8_t)pgm_read_byte(&QUADRATURE_STEPS[state]);
+}
+
 uint32_t encoder_left_total();
 uint32_t encoder_right_total();
 
@@ -42,8 +66,10 @@ void reset_encoders();
 void setup_encoders();
 void update_encoders();
 
-float robot_fwd_increment();
-float robot_rot_increment();
+// these are used by the motor controllers in systick
+control_t robot_fwd_increment();
+control_t robot_rot_increment();
+float robot_counted_fwd_increment();
 
 float robot_position();
 float robot_angle();
@@ -0,0 +1,193 @@
+/*
+ * File: estimate.cpp
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:29:33 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:34:13 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "estimate.h"
+#include "config.h"
+#include "motion.h"
+#include "mouse.h"
+#include "planner.h"
+#include "profile.h"
+#include <Arduino.h>
+
+//***************************************************************************//
+/*
+ * Profile::update() changes the speed by a fixed step each tick and then
+ * moves by the new speed for one tick. So, over a run of ticks where the
+ * speed is heading for some target, the distance moved is the sum of an
+ * arithmetic series until the target is reached and a straight multiple
+ * of the target speed after that. The functions here use those sums to
+ * find the tick on which the profile starts braking and the tick on which
+ * it finishes without having to step through the ticks one at a time.
+ */
+//***************************************************************************//
+
+/***
+ * The distance covered in n ticks that start at speed v and move the speed
+ * towards target by step each tick.
+ */
+static float ramp_distance(float v, float target, float step, uint32_t n) {
+  uint32_t k = (uint32_t)ceilf(fabsf(target - v) / step); // ticks to reach target
+  float s = (target > v) ? step : -step;
+  if (n < k) {
+    return LOOP_INTERVAL * (n * v + s * 0.5f * n * (n + 1.0f));
+  }
+  float ramp = (k > 0) ? LOOP_INTERVAL * ((k - 1) * v + s * 0.5f * (k - 1.0f) * k) : 0;
+  return ramp + LOOP_INTERVAL * (n - k + 1) * target;
+}
+
+static float ramp_speed(float v, float target, float step, uint32_t n) {
+  if (target > v) {
+    return min(target, v + n * step);
+  }
+  return max(target, v - n * step);
+}
+
+/***
+ * A profile is used up when it gets within 0.125mm of the end. Profile
+ * also starts braking once it gets to the brake position worked out when
+ * it started. This is true if either has happened after n ticks of the
+ * first phase.
+ */
+static bool phase_one_ends(float distance, float v, float top, float brake_position, float step, uint32_t n) {
+  float position = ramp_distance(v, top, step, n);
+  return distance - position < 0.125f || position >= brake_position;
+}
+
+/**
+ * This follows the same steps as Profile::start() and Profile::update(),
+ * including the way that a profile ending at zero speed creeps the last
+ * fraction of a millimetre at 5mm/s. Each phase is worked out from the
+ * sums of its ticks rather than tick by tick. The brake point and the end
+ * of the profile are found with a binary search on those sums so it only
+ * takes a few dozen sums even for a long profile.
+ *
+ * Distances and speeds can be mm and mm/s or deg and deg/s. The result is
+ * in seconds and is a whole number of systick intervals.
+ *
+ * A profile with no top speed never gets anywhere and counts as zero.
+ *
+ * @brief the time a profile takes to run
+ */
+float profile_time(float distance, float entry_speed, float top_speed, float final_speed, float acceleration) {
+  float d = fabsf(distance);
+  float v0 = fabsf(entry_speed);
+  float vt = fabsf(top_speed);
+  float vf = fabsf(final_speed);
+  float a = fabsf(acceleration);
+  if (d < 1.0 || vt < 1.0) {
+    return 0;
+  }
+  if (vf > vt) {
+    vf = vt;
+  }
+  float inverse_acc = (a >= 1) ? 1.0f / a : 1.0f;
+  float step = max(a * LOOP_INTERVAL, 1e-3f);
+  float brake = Profile::get_brake_position(d, v0, vt, vf, inverse_acc);
+
+  // phase one heads for the top speed until braking starts. Find the
+  // first tick n where that happens. The last tick can be no later than
+  // the time taken to cover the distance at top speed after reaching it
+  uint32_t low = 0;
+  uint32_t high = (uint32_t)ceilf(fabsf(vt - v0) / step) + (uint32_t)(d / (vt * LOOP_INTERVAL)) + 2;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (phase_one_ends(d, v0, vt, brake, step, mid)) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  uint32_t ticks = low + 1; // this tick either finishes or starts braking
+  float v = ramp_speed(v0, vt, step, low);
+  float remaining = d - ramp_distance(v0, vt, step, low);
+  if (remaining < 0.125f) {
+    return ticks * LOOP_INTERVAL;
+  }
+
+  // phase two brakes towards the final speed. It ends on the tick after
+  // the one that brings the remaining distance under 0.125mm
+  float target = (vf == 0) ? 5.0f : vf;
+  low = 0;
+  high = (uint32_t)ceilf(fabsf(target - v) / step) + (uint32_t)(remaining / (target * LOOP_INTERVAL)) + 2;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (remaining - ramp_distance(v, target, step, mid) < 0.125f) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  ticks += low;
+  return ticks * LOOP_INTERVAL;
+}
+
+//***************************************************************************//
+
+static float s_run_time;
+static float s_acceleration;
+
+static bool add_segment_time(const PlannedSegment &segment) {
+  TurnParameters turn;
+  switch (segment.type) {
+    case SEGMENT_STRAIGHT:
+    case SEGMENT_DIAGONAL:
+      s_run_time += profile_time(segment.length, segment.entry_speed, segment.top_speed, segment.exit_speed, s_acceleration);
+      break;
+    case SEGMENT_TURN:
+      if (get_turn_parameters(segment.turn, turn)) {
+        float scale = segment.turn_scale;
+        s_run_time += profile_time(turn.angle, 0, turn.omega * scale, 0, SPEED_RUN_TURN_ALPHA * scale * scale);
+      }
+      break;
+    case SEGMENT_SPIN_LEFT:
+    case SEGMENT_SPIN_RIGHT:
+      s_run_time += profile_time(90, 0, SPEEDMAX_SPIN_TURN, 0, SPIN_TURN_ACCELERATION);
+      break;
+  }
+  return true;
+}
+
+/**
+ * The path is planned exactly as it would be for a speed run and the time
+ * for each planned segment is added up. The result is in seconds.
+ *
+ * This uses the velocity planner so it must not be called while a speed
+ * run is being planned.
+ *
+ * @brief predict how long a speed run along a path will take
+ */
+float estimate_run_time(const uint8_t *path, bool smooth_turns, float top_speed, float acceleration) {
+  s_run_time = 0;
+  s_acceleration = acceleration;
+  plan_path(path, smooth_turns, top_speed, acceleration, add_segment_time);
+  return s_run_time;
+}
@@ -0,0 +1,47 @@
+/*
+ * File: estimate.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:29:33 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:29:33 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdint.h>
+
+/***
+ * Run times worked out from the same trapezoidal profiles that systick
+ * follows, but in closed form so that a whole speed run can be timed
+ * before it starts. Nothing here touches the hardware so these also work
+ * in a host build.
+ */
+float profile_time(float distance, float entry_speed, float top_speed, float final_speed, float acceleration);
+float estimate_run_time(const uint8_t *path, bool smooth_turns, float top_speed, float acceleration);
+
+#endif
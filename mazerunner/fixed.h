@@ -0,0 +1,181 @@
+/*
+ * File: fixed.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:40:01 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:50:13 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include "config.h"
+#include <stdint.h>
+
+/***
+ * A Fixed is a Q16.16 fixed point number. That is, a 32 bit integer that
+ * counts in units of 1/65536. The range is a little under +/-32768 with a
+ * resolution of about 0.000015.
+ *
+ * The ATmega328 has no floating point hardware so every float add or
+ * multiply is a library call costing 100 cycles or more. The same sums with
+ * a Fixed are integer adds and a few 16x16 bit multiplies.
+ *
+ * Only the conversion from a float is implicit so that mixed expressions
+ * are always worked out in fixed point. Constants get converted by the
+ * compiler. Conversions of variables cost about as much as a float
+ * multiply so keep them out of loops.
+ */
+class Fixed {
+  public:
+  Fixed() : m_raw(0) {}
+  Fixed(int value) : m_raw((int32_t)value * 65536L) {}
+  Fixed(float value) : m_raw((int32_t)(value * 65536.0f + (value < 0 ? -0.5f : 0.5f))) {}
+  Fixed(double value) : Fixed((float)value) {}
+
+  static Fixed from_raw(int32_t raw) {
+    Fixed result;
+    result.m_raw = raw;
+    return result;
+  }
+
+  int32_t raw() const { return m_raw; }
+  explicit operator float() const { return m_raw * (1.0f / 65536.0f); }
+
+  // truncates towards zero in the same way as a cast from a float
+  int to_int() const { return (int)(m_raw >= 0 ? m_raw >> 16 : -(-m_raw >> 16)); }
+
+  Fixed operator-() const { return from_raw(-m_raw); }
+  Fixed &operator+=(Fixed b) {
+    m_raw += b.m_raw;
+    return *this;
+  }
+  Fixed &operator-=(Fixed b) {
+    m_raw -= b.m_raw;
+    return *this;
+  }
+
+  friend Fixed operator+(Fixed a, Fixed b) { return from_raw(a.m_raw + b.m_raw); }
+  friend Fixed operator-(Fixed a, Fixed b) { return from_raw(a.m_raw - b.m_raw); }
+  friend Fixed operator*(Fixed a, Fixed b) { return from_raw(multiply_q16(a.m_raw, b.m_raw)); }
+  friend Fixed operator*(Fixed a, int b) { return from_raw(a.m_raw * b); }
+  friend Fixed operator*(int a, Fixed b) { return from_raw(a * b.m_raw); }
+  friend Fixed operator/(Fixed a, int32_t b) { return from_raw(a.m_raw / b); }
+  // without these, a float would be truncated to use the int versions
+  friend Fixed operator*(Fixed a, float b) { return a * Fixed(b); }
+  friend Fixed operator*(float a, Fixed b) { return Fixed(a) * b; }
+
+  friend bool operator==(Fixed a, Fixed b) { return a.m_raw == b.m_raw; }
+  friend bool operator!=(Fixed a, Fixed b) { return a.m_raw != b.m_raw; }
+  friend bool operator<(Fixed a, Fixed b) { return a.m_raw < b.m_raw; }
+  friend bool operator>(Fixed a, Fixed b) { return a.m_raw > b.m_raw; }
+  friend bool operator<=(Fixed a, Fixed b) { return a.m_raw <= b.m_raw; }
+  friend bool operator>=(Fixed a, Fixed b) { return a.m_raw >= b.m_raw; }
+
+  /***
+   * The product of two Q16.16 numbers shifted down by 16 bits. Casting to
+   * int64_t would do it in one line but avr-gcc then calls the 64 bit
+   * multiply, which works through all eight bytes of each number. Here each
+   * number is split into a signed high half and an unsigned low half and
+   * only the four 16x16 bit products are needed, each of which the compiler
+   * does with the hardware multiplier. The low product only contributes
+   * its top half.
+   *
+   * The result is exactly the same as the 64 bit version, including the
+   * wrap around on overflow, so the sums are unsigned.
+   */
+  static int32_t multiply_q16(int32_t a, int32_t b) {
+    int16_t a_hi = a >> 16;
+    uint16_t a_lo = a;
+    int16_t b_hi = b >> 16;
+    uint16_t b_lo = b;
+    uint32_t result = (uint32_t)((int32_t)a_hi * b_hi) << 16;
+    result += (uint32_t)((int32_t)a_hi * b_lo);
+    result += (uint32_t)((int32_t)b_hi * a_lo);
+    result += ((uint32_t)a_lo * b_lo) >> 16;
+    return (int32_t)result;
+  }
+
+  private:
+  int32_t m_raw;
+};
+
+inline Fixed fabsf(Fixed x) {
+  return x < 0 ? -x : x;
+}
+
+inline int to_int(Fixed x) {
+  return x.to_int();
+}
+
+inline int to_int(float x) {
+  return (int)x;
+}
+
+/***
+ * Rates get turned into per-tick changes all through systick. For a Fixed,
+ * the loop interval is held as a 32 bit fraction because, as a Fixed, it
+ * would be out by 0.05%.
+ */
+const uint32_t LOOP_INTERVAL_Q32 = (uint32_t)(LOOP_INTERVAL * 4294967296.0 + 0.5);
+const uint16_t LOOP_INTERVAL_Q32_HI = LOOP_INTERVAL_Q32 >> 16;
+const uint16_t LOOP_INTERVAL_Q32_LO = LOOP_INTERVAL_Q32 & 0xFFFF;
+static_assert(LOOP_INTERVAL_Q32_HI < 256, "per_tick() needs a loop interval under 4ms");
+
+inline float per_tick(float rate) {
+  return rate * LOOP_INTERVAL;
+}
+
+/***
+ * The rate times the 32 bit fraction, shifted down by 32 bits, done with
+ * 16x16 bit products as in Fixed::multiply_q16(). The high half of the
+ * fraction is small so the middle terms can be added in 32 bits after
+ * taking out the top half of the larger one. The result is exactly the
+ * same as the 64 bit version.
+ */
+inline Fixed per_tick(Fixed rate) {
+  int32_t raw = rate.raw();
+  int16_t rate_hi = raw >> 16;
+  uint16_t rate_lo = raw;
+  int32_t middle = (int32_t)rate_hi * LOOP_INTERVAL_Q32_LO;
+  uint32_t low = (uint32_t)rate_lo * LOOP_INTERVAL_Q32_HI + (((uint32_t)rate_lo * LOOP_INTERVAL_Q32_LO) >> 16);
+  int32_t result = (int32_t)rate_hi * LOOP_INTERVAL_Q32_HI + (middle >> 16);
+  result += (int32_t)(((uint32_t)middle & 0xFFFF) + low) >> 16;
+  return Fixed::from_raw(result);
+}
+
+/***
+ * The systick control code does its sums with a control_t. That is a float
+ * or a Fixed depending on USE_FIXED_POINT_CONTROL in config.h.
+ */
+#if USE_FIXED_POINT_CONTROL
+typedef Fixed control_t;
+#else
+typedef float control_t;
+#endif
+
+#endif
@@ -28,22 +28,152 @@
 #include "queue.h"
 #include <avr/pgmspace.h>
 
-uint8_t cost[256];
+uint16_t cost[256];
+uint8_t g_unseen_wall_mask = 0x00; // set by set_flood_mode()
 uint8_t walls[256] __attribute__((section(".noinit"))); // the maze walls are preserved after a reset
 
 static uint8_t s_goal = GOAL;
+static uint8_t s_goal_size = GOAL_SIZE;
 
-void set_maze_goal(uint8_t goal_cell) {
+// remember what the cost array holds so that it can be repaired rather
+// than recalculated when new walls are found
+static uint8_t s_flood_target = GOAL;
+static uint8_t s_flood_size = GOAL_SIZE;
+static bool s_flood_valid = false;
+
+/***
+ * The flood queue must be big enough to hold every cell that can be waiting
+ * at the same time.
+ *
+ * In flood_maze() a cell is only queued when its cost is set and, because
+ * the first visit in a breadth-first flood is always the cheapest, that
+ * happens once per cell. Only the target cells are added before the first
+ * cell is removed so there can never be more than 255 cells waiting, as
+ * long as the target is not the whole maze. The repair in
+ * flood_update_after_walls() never queues a cell that is already waiting
+ * and only queues the starting cells before the first cell is removed so
+ * the same limit applies. The weighted flood can queue a cell more than once but
+ * never while it is still waiting, so it is limited in the same way.
+ *
+ * A 256 slot queue holds 255 items so it can never overflow in a 16x16
+ * maze. The old 64 item queue could overflow in open mazes.
+ *
+ * There is only one queue and every flood shares it. None of them calls
+ * another while its own queue is in use and nothing floods from an
+ * interrupt. A queue on the stack of each flood would put 256 bytes on
+ * the stack every time a flood was nested inside another function that
+ * also needed one. On a 2K processor that could run the stack into the
+ * global variables.
+ */
+typedef Queue<uint8_t, 256> FloodQueue;
+static_assert(FloodQueue::CAPACITY >= 255, "Flood queue too small for a 16x16 maze");
+static FloodQueue s_flood_queue;
+
+#if FLOOD_BITBOARD
+/***
+ * A column of the maze is 16 cells so it fits in a single uint16_t with
+ * bit n holding the cell in row n. The bitboard flood keeps the north and
+ * east wall of every cell in that form, one plane for the walls that are
+ * present and one for the walls that have been observed. The south and
+ * west walls are the north and east walls of the neighbours.
+ *
+ * The planes are kept up to date by the wall functions so the flood does
+ * not have to build them each time. They are not kept through a reset
+ * like walls[] so they are rebuilt the first time they are needed.
+ */
+static uint16_t s_north_present[16];
+static uint16_t s_north_seen[16];
+static uint16_t s_east_present[16];
+static uint16_t s_east_seen[16];
+static bool s_planes_valid = false;
+
+static inline void copy_wall_bit(uint16_t &plane, uint16_t bit, bool value) {
+  if (value) {
+    plane |= bit;
+  } else {
+    plane &= ~bit;
+  }
+}
+
+static void copy_cell_to_planes(uint8_t cell) {
+  uint8_t col = cell >> 4;
+  uint16_t bit = 1 << (cell & 0x0F);
+  uint8_t wallData = walls[cell];
+  copy_wall_bit(s_north_present[col], bit, wallData & (1 << NORTH));
+  copy_wall_bit(s_north_seen[col], bit, wallData & observed_bit(NORTH));
+  copy_wall_bit(s_east_present[col], bit, wallData & (1 << EAST));
+  copy_wall_bit(s_east_seen[col], bit, wallData & observed_bit(EAST));
+}
+
+/***
+ * Copy all four walls of a cell into the planes. The south and west walls
+ * belong to the neighbours in the planes so they are copied from there.
+ */
+void refresh_wall_planes(uint8_t cell) {
+  if (not s_planes_valid) {
+    return; // they will all be copied before the next flood
+  }
+  copy_cell_to_planes(cell);
+  if (cell & 0x0F) {
+    copy_cell_to_planes(cell - 1);
+  }
+  if (cell >= 16) {
+    copy_cell_to_planes(cell - 16);
+  }
+}
+
+static void rebuild_wall_planes() {
+  for (int cell = 0; cell < 256; cell++) {
+    copy_cell_to_planes(cell);
+  }
+  s_planes_valid = true;
+}
+#endif
+
+/***
+ * The goal is a square region of cells. In a full size contest maze it is
+ * the four cells in the centre. The goal_cell is the south west corner of
+ * the region and size is the number of cells along each side. The size is
+ * reduced if necessary so that the region fits inside the maze.
+ *
+ * flood_maze_goal() gives every cell in the region a cost of zero so the
+ * mouse will head for whichever goal cell is nearest.
+ */
+void set_maze_goal(uint8_t goal_cell, uint8_t size) {
+  uint8_t row = goal_cell & 0x0F;
+  uint8_t col = goal_cell >> 4;
+  if (size < 1) {
+    size = 1;
+  }
+  if (row + size > MAZE_WIDTH) {
+    size = MAZE_WIDTH - row;
+  }
+  if (col + size > MAZE_WIDTH) {
+    size = MAZE_WIDTH - col;
+  }
   s_goal = goal_cell;
+  s_goal_size = size;
+  s_flood_valid = false;
 }
 
 uint8_t maze_goal() {
   return s_goal;
 }
 
+uint8_t maze_goal_size() {
+  return s_goal_size;
+}
+
+bool is_goal(uint8_t cell) {
+  uint8_t row = (cell & 0x0F) - (s_goal & 0x0F);
+  uint8_t col = (cell >> 4) - (s_goal >> 4);
+  return row < s_goal_size && col < s_goal_size;
+}
+
 /***
  * Set a single wall in the maze. Each wall is set from two directions
- * so that it is consistent when seen from the neighbouring cell.
+ * so that it is consistent when seen from the neighbouring cell. The wall
+ * is marked as observed.
  *
  * The wall is set unconditionally regardless of whether there is
  * already a wall present
@@ -54,29 +184,31 @@ void set_wall_present(uint8_t cell, uint8_t direction) {
   uint16_t nextCell = neighbour(cell, direction);
   switch (direction) {
     case NORTH:
-      walls[cell] |= (1 << NORTH);
-      walls[nextCell] |= (1 << SOUTH);
+      walls[cell] |= (1 << NORTH) | observed_bit(NORTH);
+      walls[nextCell] |= (1 << SOUTH) | observed_bit(SOUTH);
       break;
     case EAST:
-      walls[cell] |= (1 << EAST);
-      walls[nextCell] |= (1 << WEST);
+      walls[cell] |= (1 << EAST) | observed_bit(EAST);
+      walls[nextCell] |= (1 << WEST) | observed_bit(WEST);
       break;
     case SOUTH:
-      walls[cell] |= (1 << SOUTH);
-      walls[nextCell] |= (1 << NORTH);
+      walls[cell] |= (1 << SOUTH) | observed_bit(SOUTH);
+      walls[nextCell] |= (1 << NORTH) | observed_bit(NORTH);
       break;
     case WEST:
-      walls[cell] |= (1 << WEST);
-      walls[nextCell] |= (1 << EAST);
+      walls[cell] |= (1 << WEST) | observed_bit(WEST);
+      walls[nextCell] |= (1 << EAST) | observed_bit(EAST);
       break;
     default:; // do nothing - although this is an error
       break;
   }
+  refresh_wall_planes(cell);
 }
 
 /***
  * Clear a single wall in the maze. Each wall is cleared from two directions
- * so that it is consistent when seen from the neighbouring cell.
+ * so that it is consistent when seen from the neighbouring cell. The wall
+ * is marked as observed.
  *
  * The wall is cleared unconditionally regardless of whether there is
  * already a wall present
@@ -86,26 +218,80 @@ void set_wall_present(uint8_t cell, uint8_t direction) {
  */
 void set_wall_absent(uint8_t cell, uint8_t direction) {
   uint16_t nextCell = neighbour(cell, direction);
+  s_flood_valid = false; // costs may fall so a repair is not possible
   switch (direction) {
     case NORTH:
-      walls[cell] &= ~(1 << NORTH);
-      walls[nextCell] &= ~(1 << SOUTH);
+      walls[cell] = (walls[cell] & ~(1 << NORTH)) | observed_bit(NORTH);
+      walls[nextCell] = (walls[nextCell] & ~(1 << SOUTH)) | observed_bit(SOUTH);
       break;
     case EAST:
-      walls[cell] &= ~(1 << EAST);
-      walls[nextCell] &= ~(1 << WEST);
+      walls[cell] = (walls[cell] & ~(1 << EAST)) | observed_bit(EAST);
+      walls[nextCell] = (walls[nextCell] & ~(1 << WEST)) | observed_bit(WEST);
       break;
     case SOUTH:
-      walls[cell] &= ~(1 << SOUTH);
-      walls[nextCell] &= ~(1 << NORTH);
+      walls[cell] = (walls[cell] & ~(1 << SOUTH)) | observed_bit(SOUTH);
+      walls[nextCell] = (walls[nextCell] & ~(1 << NORTH)) | observed_bit(NORTH);
       break;
     case WEST:
-      walls[cell] &= ~(1 << WEST);
-      walls[nextCell] &= ~(1 << EAST);
+      walls[cell] = (walls[cell] & ~(1 << WEST)) | observed_bit(WEST);
+      walls[nextCell] = (walls[nextCell] & ~(1 << EAST)) | observed_bit(EAST);
       break;
     default:; // do nothing - although this is an error
       break;
   }
+  refresh_wall_planes(cell);
+}
+
+/***
+ * Record that a wall has been observed without changing whether it is
+ * present. Used when the sensors see no wall where the map may already
+ * have one. Walls are never removed during a search so that a single bad
+ * sensor reading cannot open up a route.
+ *
+ * As with the other wall functions, take care not to use this on the
+ * maze boundary.
+ */
+void mark_wall_observed(uint8_t cell, uint8_t direction) {
+  if (g_unseen_wall_mask) {
+    s_flood_valid = false; // a pessimistic flood may see a new opening
+  }
+  walls[cell] |= observed_bit(direction);
+  walls[neighbour(cell, direction)] |= observed_bit((direction + 2) & 0x03);
+  refresh_wall_planes(cell);
+}
+
+/***
+ * Choose whether floods treat walls that have not been observed as absent
+ * or present. A search uses the optimistic mode so that the mouse will go
+ * and look at unknown parts of the maze. The pessimistic mode only allows
+ * routes that are known to be open so it is safe for a speed run.
+ */
+void set_flood_mode(FloodMode mode) {
+  s_flood_valid = false;
+  g_unseen_wall_mask = (mode == PESSIMISTIC) ? 0x0F : 0x00;
+}
+
+FloodMode flood_mode() {
+  return g_unseen_wall_mask ? PESSIMISTIC : OPTIMISTIC;
+}
+
+/***
+ * The optimistic flood gives the lowest cost that any route could have
+ * while the pessimistic flood gives the cost of the best route that is
+ * known to be open. When they are the same, no amount of extra searching
+ * can find anything better and the route is proven.
+ *
+ * Both floods are to the square region of the given size with the target
+ * in its south west corner. The cost array is left holding the
+ * optimistic flood and the flood mode is left as OPTIMISTIC.
+ */
+bool route_is_proven(uint8_t start, uint8_t target, uint8_t size) {
+  set_flood_mode(PESSIMISTIC);
+  flood_maze(target, size);
+  uint16_t known = cost[start];
+  set_flood_mode(OPTIMISTIC);
+  flood_maze(target, size);
+  return known != MAX_COST && known == cost[start];
 }
 
 /***
@@ -114,26 +300,40 @@ void set_wall_absent(uint8_t cell, uint8_t direction) {
  * If a test maze is provided, the walls will all be set up from that
  * No attempt is made to verufy the correctness of a test maze.
  *
+ * Either way, the boundary walls and the walls of the start cell are
+ * known before the mouse moves so they are marked as observed.
  */
 void initialise_maze(const uint8_t *testMaze = nullptr) {
+  s_flood_valid = false;
+#if FLOOD_BITBOARD
+  s_planes_valid = false;
+#endif
   for (int i = 0; i < 256; i++) {
     cost[i] = 0;
     walls[i] = 0;
   }
   if (testMaze) {
     copy_walls_from_flash(testMaze);
-    return;
+  } else {
+    // place the boundary walls.
+    for (uint8_t i = 0; i < 16; i++) {
+      set_wall_present(i, WEST);
+      set_wall_present(15 * 16 + i, EAST);
+      set_wall_present(i * 16, SOUTH);
+      set_wall_present((16 * i + 15), NORTH);
+    }
+    // and the start cell walls.
+    set_wall_present(START, EAST);
+    set_wall_absent(START, NORTH);
   }
-  // place the boundary walls.
   for (uint8_t i = 0; i < 16; i++) {
-    set_wall_present(i, WEST);
-    set_wall_present(15 * 16 + i, EAST);
-    set_wall_present(i * 16, SOUTH);
-    set_wall_present((16 * i + 15), NORTH);
+    walls[i] |= observed_bit(WEST);
+    walls[15 * 16 + i] |= observed_bit(EAST);
+    walls[i * 16] |= observed_bit(SOUTH);
+    walls[16 * i + 15] |= observed_bit(NORTH);
   }
-  // and the start cell walls.
-  set_wall_present(START, EAST);
-  set_wall_absent(START, NORTH);
+  mark_wall_observed(START, NORTH);
+  mark_wall_observed(START, EAST);
 }
 
 uint8_t cell_north(uint8_t cell) {
@@ -172,7 +372,7 @@ uint8_t neighbour(uint8_t cell, uint8_t direction) {
       next = cell_west(cell);
       break;
     default:
-      next = MAX_COST;
+      next = 255;
   }
   return next;
 }
@@ -180,9 +380,9 @@ uint8_t neighbour(uint8_t cell, uint8_t direction) {
 /***
  * Assumes the maze has been flooded
  */
-uint8_t neighbour_cost(uint8_t cell, uint8_t direction) {
-  uint8_t result = MAX_COST;
-  uint8_t wallData = walls[cell];
+uint16_t neighbour_cost(uint8_t cell, uint8_t direction) {
+  uint16_t result = MAX_COST;
+  uint8_t wallData = closed_walls(cell);
   switch (direction) {
     case NORTH:
       if ((wallData & (1 << NORTH)) == 0) {
@@ -211,6 +411,33 @@ uint8_t neighbour_cost(uint8_t cell, uint8_t direction) {
   return result;
 }
 
+/***
+ * Fill the cost array with the manhattan distance from every cell to the
+ * target region using whichever flood is selected by FLOOD_BITBOARD in
+ * maze.h. Both give identical results.
+ *
+ * A flood takes a few milliseconds. If the caller cannot wait that long,
+ * it can pass a stop function that the flood calls every so often. As soon
+ * as that returns true, the flood gives up and the costs are left only
+ * partly worked out.
+ *
+ * @param target - the cell from which all distances are calculated
+ * @param size   - the number of cells along each side of the region
+ * @param stop   - called during the flood. The flood ends if it returns true
+ *
+ * Returns false if the flood was stopped before it was finished.
+ */
+bool flood_maze(uint8_t target, uint8_t size, FloodStop stop) {
+  s_flood_target = target;
+  s_flood_size = size;
+#if FLOOD_BITBOARD
+  s_flood_valid = flood_maze_bitboard(target, size, stop);
+#else
+  s_flood_valid = flood_maze_queue(target, size, stop);
+#endif
+  return s_flood_valid;
+}
+
 /***
  * Very simple cell counting flood fills cost array with the
  * manhattan distance from every cell to the target.
@@ -219,16 +446,38 @@ uint8_t neighbour_cost(uint8_t cell, uint8_t direction) {
  * examines each accessible cell exactly once. Consequently, it runs
  * in fairly constant time, taking 5.3ms when there are no interrupts.
  *
+ * The queue is a fixed size buffer shared by all the floods so there is no
+ * use of the heap. Test 23 reports the time taken.
+ *
+ * The flood can start from a square region of cells, all with a cost of
+ * zero. The target is the south west corner of the region and size is the
+ * number of cells along each side. A single cell is a region of size 1.
+ *
+ * The stop function, if there is one, is called once for every 16 cells
+ * taken from the queue.
+ *
  * @param target - the cell from which all distances are calculated
+ * @param size   - the number of cells along each side of the region
+ * @param stop   - called during the flood. The flood ends if it returns true
  */
-void flood_maze(uint8_t target) {
+bool flood_maze_queue(uint8_t target, uint8_t size, FloodStop stop) {
   for (int i = 0; i < 256; i++) {
     cost[i] = MAX_COST;
   }
-  Queue<uint8_t> queue;
-  cost[target] = 0;
-  queue.add(target);
-  while (queue.size() > 0) {
+  FloodQueue &queue = s_flood_queue;
+  queue.clear();
+  for (uint8_t col = 0; col < size; col++) {
+    for (uint8_t row = 0; row < size; row++) {
+      uint8_t cell = target + col * 16 + row;
+      cost[cell] = 0;
+      queue.add(cell);
+    }
+  }
+  uint8_t count = 0;
+  while (not queue.empty()) {
+    if (stop and (++count & 0x0F) == 0 and stop()) {
+      return false;
+    }
     uint8_t here = queue.head();
     uint16_t newCost = cost[here] + 1;
 
@@ -242,6 +491,524 @@ void flood_maze(uint8_t target) {
       }
     }
   }
+  return true;
+}
+
+#if FLOOD_BITBOARD
+static inline void set_wave_cost(uint16_t *cellCost, uint8_t bits, uint16_t value) {
+  while (bits) {
+    if (bits & 1) {
+      *cellCost = value;
+    }
+    bits >>= 1;
+    cellCost++;
+  }
+}
+
+/***
+ * The bitboard flood moves the whole wavefront at once instead of one cell
+ * at a time. One shift and mask moves the front a cell north or south in
+ * every cell of a column and a mask moves a whole column east or west.
+ * Each pass of the main loop is one wave so every cell it reaches has the
+ * same cost. Only the columns on or next to the front are looked at.
+ *
+ * The open walls for the current flood mode are worked out a column at a
+ * time from the persistent wall planes.
+ *
+ * The costs are identical to those from flood_maze_queue() as long as each
+ * wall looks the same from both sides, which the wall functions make sure
+ * of.
+ *
+ * The stop function, if there is one, is called before each wave.
+ *
+ * @param target - the cell from which all distances are calculated
+ * @param size   - the number of cells along each side of the region
+ * @param stop   - called during the flood. The flood ends if it returns true
+ */
+bool flood_maze_bitboard(uint8_t target, uint8_t size, FloodStop stop) {
+  if (not s_planes_valid) {
+    rebuild_wall_planes();
+  }
+  uint16_t unseenOpen = g_unseen_wall_mask ? 0x0000 : 0xFFFF;
+  uint16_t openNorth[16]; // bit set if there is no wall to the north
+  uint16_t openEast[16];  // bit set if there is no wall to the east
+  uint16_t reached[16];
+  uint16_t front[16];
+  for (uint8_t col = 0; col < 16; col++) {
+    openNorth[col] = ~s_north_present[col] & (s_north_seen[col] | unseenOpen) & 0x7FFF;
+    openEast[col] = ~s_east_present[col] & (s_east_seen[col] | unseenOpen);
+    reached[col] = 0;
+    front[col] = 0;
+  }
+  for (int i = 0; i < 256; i++) {
+    cost[i] = MAX_COST;
+  }
+  uint8_t first = target >> 4;
+  uint8_t last = first + size - 1;
+  uint16_t seeds = ((1UL << size) - 1) << (target & 0x0F);
+  for (uint8_t col = first; col <= last; col++) {
+    front[col] = seeds;
+    reached[col] = seeds;
+    set_wave_cost(&cost[col * 16], seeds, 0);
+    set_wave_cost(&cost[col * 16 + 8], seeds >> 8, 0);
+  }
+  uint16_t wave = 0;
+  while (first <= last) {
+    if (stop and stop()) {
+      return false;
+    }
+    wave++;
+    uint8_t lo = (first > 0) ? first - 1 : 0;
+    uint8_t hi = (last < 15) ? last + 1 : 15;
+    first = 16;
+    last = 0;
+    uint16_t fromWest = 0; // cells entered from the column to the west
+    for (uint8_t col = lo; col <= hi; col++) {
+      uint16_t here = front[col];
+      uint16_t next = fromWest;
+      if (col < 15) {
+        next |= front[col + 1] & openEast[col];
+      }
+      if ((here | next) == 0) {
+        continue; // nothing in or next to this column
+      }
+      next |= ((here & openNorth[col]) << 1) | ((here >> 1) & openNorth[col]);
+      fromWest = here & openEast[col];
+      next &= ~reached[col];
+      reached[col] |= next;
+      front[col] = next;
+      if (next) {
+        if (col < first) {
+          first = col;
+        }
+        last = col;
+        set_wave_cost(&cost[col * 16], next, wave);
+        set_wave_cost(&cost[col * 16 + 8], next >> 8, wave);
+      }
+    }
+  }
+  return true;
+}
+#endif
+
+/***
+ * Flood to the whole goal region so that every goal cell has a cost of
+ * zero.
+ */
+void flood_maze_goal() {
+  flood_maze(s_goal, s_goal_size);
+}
+
+/***
+ * Small bitmap with one bit per cell. Used by the flood repair to keep
+ * track of cells without needing another 256 byte array.
+ */
+static inline bool test_cell_flag(const uint8_t *flags, uint8_t cell) {
+  return (flags[cell >> 3] & (1 << (cell & 0x07))) != 0;
+}
+
+static inline void set_cell_flag(uint8_t *flags, uint8_t cell) {
+  flags[cell >> 3] |= (1 << (cell & 0x07));
+}
+
+static inline void clear_cell_flag(uint8_t *flags, uint8_t cell) {
+  flags[cell >> 3] &= ~(1 << (cell & 0x07));
+}
+
+/***
+ * During a search, walls are only ever added. Adding a wall can never make
+ * a cell cheaper so, instead of re-flooding all 256 cells after every
+ * update_map(), only the cells whose cost actually depended on the new
+ * walls need to be recalculated. This is the same idea as the repair step
+ * in LPA* or D* Lite, simplified for a flood with unit costs.
+ *
+ * The repair works in two passes:
+ *
+ *  1. Starting from the cells either side of each new wall, any cell
+ *     that no longer has an open neighbour costing one less than itself
+ *     has lost its route. Its cost is discarded and the neighbours that
+ *     were relying on it are checked in turn.
+ *  2. Each of those orphaned cells is re-seeded from its cheapest
+ *     remaining neighbour and the new costs are pushed outwards until
+ *     nothing changes.
+ *
+ * Cells that still have a valid route keep their cost, which is exact
+ * because walls only make routes longer.
+ *
+ * The result is identical to calling flood_maze() for the same target.
+ * If the cost array cannot be repaired, perhaps because walls have been
+ * removed or the maze reset, a full flood is done instead.
+ *
+ * The target and region size are the ones given in the most recent call
+ * to flood_maze().
+ *
+ * @param cell         - the cell where new walls have been added
+ * @param changed_mask - bit n is set if a wall was added in direction n
+ */
+void flood_update_after_walls(uint8_t cell, uint8_t changed_mask) {
+  if (not s_flood_valid) {
+    flood_maze(s_flood_target, s_flood_size);
+    return;
+  }
+  if ((changed_mask & 0x0F) == 0) {
+    return;
+  }
+  uint8_t queued[32] = {0};
+  uint8_t orphans[32] = {0};
+  FloodQueue &queue = s_flood_queue;
+  queue.clear();
+
+  queue.add(cell);
+  set_cell_flag(queued, cell);
+  for (uint8_t direction = 0; direction < 4; direction++) {
+    if (changed_mask & (1 << direction)) {
+      uint8_t nextCell = neighbour(cell, direction);
+      if (not test_cell_flag(queued, nextCell)) {
+        queue.add(nextCell);
+        set_cell_flag(queued, nextCell);
+      }
+    }
+  }
+
+  // pass 1: find every cell that has lost its route to the target
+  bool found_orphans = false;
+  while (not queue.empty()) {
+    uint8_t here = queue.head();
+    clear_cell_flag(queued, here);
+    uint16_t hereCost = cost[here];
+    if (hereCost == 0 || hereCost == MAX_COST) {
+      continue; // the target and unreachable cells never need repair
+    }
+    bool supported = false;
+    for (uint8_t direction = 0; direction < 4; direction++) {
+      if (is_exit(here, direction) && cost[neighbour(here, direction)] == hereCost - 1) {
+        supported = true;
+        break;
+      }
+    }
+    if (supported) {
+      continue;
+    }
+    cost[here] = MAX_COST;
+    set_cell_flag(orphans, here);
+    found_orphans = true;
+    for (uint8_t direction = 0; direction < 4; direction++) {
+      if (is_exit(here, direction)) {
+        uint8_t nextCell = neighbour(here, direction);
+        if (cost[nextCell] == hereCost + 1 && not test_cell_flag(queued, nextCell)) {
+          queue.add(nextCell);
+          set_cell_flag(queued, nextCell);
+        }
+      }
+    }
+  }
+  if (not found_orphans) {
+    return;
+  }
+
+  // pass 2: seed the orphans from their cheapest neighbours ...
+  for (uint16_t i = 0; i < 256; i += 8) {
+    if (orphans[i >> 3] == 0) {
+      continue;
+    }
+    for (uint16_t here = i; here < i + 8; here++) {
+      if (not test_cell_flag(orphans, here)) {
+        continue;
+      }
+      uint16_t smallest = MAX_COST;
+      for (uint8_t direction = 0; direction < 4; direction++) {
+        if (is_exit(here, direction)) {
+          uint16_t nextCost = cost[neighbour(here, direction)];
+          if (nextCost < smallest) {
+            smallest = nextCost;
+          }
+        }
+      }
+      if (smallest < MAX_COST) {
+        cost[here] = smallest + 1;
+        queue.add(here);
+        set_cell_flag(queued, here);
+      }
+    }
+  }
+  // ... and let the new costs settle
+  while (not queue.empty()) {
+    uint8_t here = queue.head();
+    clear_cell_flag(queued, here);
+    uint16_t newCost = cost[here] + 1;
+    for (uint8_t direction = 0; direction < 4; direction++) {
+      if (is_exit(here, direction)) {
+        uint8_t nextCell = neighbour(here, direction);
+        if (cost[nextCell] > newCost) {
+          cost[nextCell] = newCost;
+          if (not test_cell_flag(queued, nextCell)) {
+            queue.add(nextCell);
+            set_cell_flag(queued, nextCell);
+          }
+        }
+      }
+    }
+  }
+}
+
+/***
+ * The weighted flood needs to know which way it was travelling when it
+ * reached each cell. Two bits per cell is enough so 256 directions fit
+ * in 64 bytes.
+ */
+static inline uint8_t get_cell_direction(const uint8_t *directions, uint8_t cell) {
+  return (directions[cell >> 2] >> ((cell & 0x03) * 2)) & 0x03;
+}
+
+static inline void set_cell_direction(uint8_t *directions, uint8_t cell, uint8_t direction) {
+  uint8_t shift = (cell & 0x03) * 2;
+  directions[cell >> 2] = (directions[cell >> 2] & ~(0x03 << shift)) | (direction << shift);
+}
+
+/***
+ * A manhattan flood finds the route with the fewest cells but that is not
+ * always the quickest to run. A mouse is much faster on a straight than it
+ * is going round a turn so a route with a few more cells and fewer turns
+ * will often win.
+ *
+ * This flood charges straight_cost to move into a cell in the same
+ * direction as the previous move and turn_cost if the direction changes.
+ * Because the cost of a cell now depends on how it was reached, a cell may
+ * be improved after it has been visited. Cells are queued again whenever
+ * that happens and the flood carries on until nothing changes. The cell
+ * costs only ever fall so it must finish.
+ *
+ * Since the flood runs backwards from the target, a change of direction
+ * in a cell corresponds to a turn in that cell when the mouse runs
+ * forwards along the route. The target cells have no direction so every
+ * move out of them is counted as straight.
+ *
+ * This is a heuristic, not an exact fastest-route search. Each cell keeps
+ * only the direction of its cheapest arrival, so a slightly dearer arrival
+ * from another direction is thrown away even when it would save a turn
+ * on the next move. Doing it exactly needs a cost for each cell and
+ * direction, which is 2K of RAM and more than the ATmega328 has. In
+ * practice it still finds routes with far fewer turns than a manhattan
+ * flood.
+ *
+ * The result can be followed by make_path() in exactly the same way as
+ * the manhattan flood. Costs are only relative so the units do not
+ * matter here. Totals that would not fit in 16 bits stop at MAX_COST - 1
+ * so they are still reachable but never cheaper than a real route.
+ *
+ * The repair in flood_update_after_walls() only understands unit costs
+ * so a call to that after this will do a full manhattan flood.
+ *
+ * @param target        - the cell from which all costs are calculated
+ * @param straight_cost - the cost of moving on in the same direction
+ * @param turn_cost     - the cost of entering a cell after a turn
+ * @param size          - the number of cells along each side of the target region
+ */
+void flood_maze_weighted(uint8_t target, uint16_t straight_cost, uint16_t turn_cost, uint8_t size) {
+  s_flood_target = target;
+  s_flood_size = size;
+  s_flood_valid = false;
+  for (int i = 0; i < 256; i++) {
+    cost[i] = MAX_COST;
+  }
+  uint8_t directions[64] = {0};
+  uint8_t queued[32] = {0};
+  FloodQueue &queue = s_flood_queue;
+  queue.clear();
+  for (uint8_t col = 0; col < size; col++) {
+    for (uint8_t row = 0; row < size; row++) {
+      uint8_t cell = target + col * 16 + row;
+      cost[cell] = 0;
+      queue.add(cell);
+      set_cell_flag(queued, cell);
+    }
+  }
+  while (not queue.empty()) {
+    uint8_t here = queue.head();
+    clear_cell_flag(queued, here);
+    uint8_t arrived = get_cell_direction(directions, here);
+    for (uint8_t direction = 0; direction < 4; direction++) {
+      if (is_exit(here, direction)) {
+        uint16_t step = turn_cost;
+        if (cost[here] == 0 || direction == arrived) {
+          step = straight_cost;
+        }
+        // saturate rather than wrap so that a very long route can never
+        // look cheaper than a short one
+        uint16_t newCost = MAX_COST - 1;
+        if (cost[here] < MAX_COST - 1 - step) {
+          newCost = cost[here] + step;
+        }
+        uint8_t nextCell = neighbour(here, direction);
+        if (cost[nextCell] > newCost) {
+          cost[nextCell] = newCost;
+          set_cell_direction(directions, nextCell, direction);
+          if (not test_cell_flag(queued, nextCell)) {
+            queue.add(nextCell);
+            set_cell_flag(queued, nextCell);
+          }
+        }
+      }
+    }
+  }
+}
+
+/***
+ * The few candidate cells that next_cell_to_explore() plans a tour
+ * through, with the distances between them.
+ */
+struct ExploreTour {
+  uint8_t count;
+  uint8_t cell[EXPLORE_TOUR_CELLS];
+  uint16_t fromMouse[EXPLORE_TOUR_CELLS];
+  uint16_t toDestination[EXPLORE_TOUR_CELLS];
+  uint16_t between[EXPLORE_TOUR_CELLS][EXPLORE_TOUR_CELLS];
+};
+
+/***
+ * The length of the shortest way to visit every tour cell not yet in the
+ * done mask, starting from tour cell last, and then go on to the
+ * destination. There are only a few cells so trying every order is
+ * quick.
+ */
+static uint16_t rest_of_tour(const ExploreTour &tour, uint8_t last, uint8_t done) {
+  if (done == (1 << tour.count) - 1) {
+    return tour.toDestination[last];
+  }
+  uint16_t shortest = MAX_COST;
+  for (uint8_t i = 0; i < tour.count; i++) {
+    if (done & (1 << i)) {
+      continue;
+    }
+    uint16_t length = tour.between[last][i] + rest_of_tour(tour, i, done | (1 << i));
+    if (length < shortest) {
+      shortest = length;
+    }
+  }
+  return shortest;
+}
+
+/***
+ * Decide where the mouse should go next to finish exploring the maze.
+ *
+ * Only cells that lie on one of the shortest routes from start to the goal
+ * can make the route shorter so only unvisited cells on those routes are
+ * worth a visit. The routes are found by flooding optimistically to the
+ * goal and then following every step that reduces the cost by one from
+ * the start cell.
+ *
+ * The mouse is on its way to the destination. The EXPLORE_TOUR_CELLS
+ * candidates nearest to the mouse are put in every possible order and the
+ * one chosen is the first cell of the shortest tour from the mouse,
+ * through all of them, to the destination. Just heading for the nearest
+ * cell can leave the mouse zig-zagging across the maze when a different
+ * order would pick the cells up on the way.
+ *
+ * Visiting a cell will often change the routes so it is better to call
+ * this again after each cell is reached than to plan a whole tour in
+ * advance. It needs a flood for the routes, one from the mouse, one from
+ * the destination and one from each tour cell but the last.
+ *
+ * The cost array is left holding one of those floods so it must be
+ * flooded again before it is used.
+ *
+ * @param from             - the cell the mouse is in now
+ * @param start            - the start of the route being proven
+ * @param destination      - where the mouse is going when it has finished
+ * @param destination_size - the size of the destination region
+ * @return the cell to explore next or from if there is nothing left
+ */
+uint8_t next_cell_to_explore(uint8_t from, uint8_t start, uint8_t destination, uint8_t destination_size) {
+  uint8_t onRoute[32] = {0};
+  set_flood_mode(OPTIMISTIC);
+  flood_maze_goal();
+  if (cost[start] == MAX_COST) {
+    return from;
+  }
+  FloodQueue &queue = s_flood_queue;
+  queue.clear();
+  queue.add(start);
+  set_cell_flag(onRoute, start);
+  while (not queue.empty()) {
+    uint8_t here = queue.head();
+    uint16_t nextCost = cost[here] - 1;
+    if (cost[here] == 0) {
+      continue;
+    }
+    for (uint8_t direction = 0; direction < 4; direction++) {
+      if (is_exit(here, direction)) {
+        uint8_t nextCell = neighbour(here, direction);
+        if (cost[nextCell] == nextCost && not test_cell_flag(onRoute, nextCell)) {
+          set_cell_flag(onRoute, nextCell);
+          queue.add(nextCell);
+        }
+      }
+    }
+  }
+  // goal cells are left out because a route ends as soon as it gets to
+  // one so nothing about the rest of its walls matters
+  for (uint16_t cell = 0; cell < 256; cell++) {
+    if (cost[cell] == 0 || cell_is_visited(cell)) {
+      clear_cell_flag(onRoute, cell);
+    }
+  }
+
+  // the nearest candidates, in order of distance from the mouse
+  ExploreTour tour;
+  tour.count = 0;
+  flood_maze(from);
+  for (uint16_t cell = 0; cell < 256; cell++) {
+    uint16_t distance = cost[cell];
+    if (not test_cell_flag(onRoute, cell) || distance == MAX_COST) {
+      continue;
+    }
+    uint8_t i = tour.count;
+    if (i == EXPLORE_TOUR_CELLS) {
+      if (distance >= tour.fromMouse[i - 1]) {
+        continue;
+      }
+      i--;
+    } else {
+      tour.count++;
+    }
+    while (i > 0 && tour.fromMouse[i - 1] > distance) {
+      tour.cell[i] = tour.cell[i - 1];
+      tour.fromMouse[i] = tour.fromMouse[i - 1];
+      i--;
+    }
+    tour.cell[i] = cell;
+    tour.fromMouse[i] = distance;
+  }
+  if (tour.count == 0) {
+    return from;
+  }
+
+  flood_maze(destination, destination_size);
+  for (uint8_t i = 0; i < tour.count; i++) {
+    tour.toDestination[i] = cost[tour.cell[i]];
+    if (tour.toDestination[i] == MAX_COST) {
+      return from; // walled off from the destination
+    }
+  }
+  // the distances are the same both ways so the last cell needs no flood
+  for (uint8_t i = 0; i + 1 < tour.count; i++) {
+    flood_maze(tour.cell[i]);
+    for (uint8_t j = i + 1; j < tour.count; j++) {
+      tour.between[i][j] = cost[tour.cell[j]];
+      tour.between[j][i] = cost[tour.cell[j]];
+    }
+  }
+
+  uint8_t best = tour.cell[0];
+  uint16_t shortest = MAX_COST;
+  for (uint8_t i = 0; i < tour.count; i++) {
+    uint16_t length = tour.fromMouse[i] + rest_of_tour(tour, i, 1 << i);
+    if (length < shortest) {
+      shortest = length;
+      best = tour.cell[i];
+    }
+  }
+  return best;
 }
 
 /***
@@ -293,6 +1060,10 @@ uint8_t direction_to_smallest(uint8_t cell, uint8_t startDirection) {
  * them without using the PROGMEM stuff
  */
 void copy_walls_from_flash(const uint8_t *src) {
+  s_flood_valid = false;
+#if FLOOD_BITBOARD
+  s_planes_valid = false;
+#endif
   memcpy_P(walls, src, 256);
 }
 
@@ -31,6 +31,7 @@
 
 #define MAZE_WIDTH 16
 #define GOAL 0x77
+#define GOAL_SIZE 2 // the goal is a square of cells with GOAL in the south west corner
 #define START 0x00
 
 // directions for mapping
@@ -39,55 +40,125 @@
 #define SOUTH 2
 #define WEST 3
 
+// The low nibble of each walls[] entry has a bit set for each wall that
+// is present. The high nibble has bit (4 + n) set once the wall in direction
+// n has been observed, either present or absent. A cell is visited when all
+// four of its walls have been observed.
 #define VISITED 0xF0
 
+// the number of cells next_cell_to_explore() plans a tour through
+#define EXPLORE_TOUR_CELLS 3
+
+// flood_maze() uses the bitboard flood when this is 1 and the queue based
+// flood when it is 0. They give the same costs. The bitboard flood keeps a
+// copy of the walls as bit planes, which costs another 128 bytes of RAM.
+// Test 23 times them both.
+#define FLOOD_BITBOARD 0
+
+enum FloodMode {
+  OPTIMISTIC,  // walls that have not been observed are treated as absent
+  PESSIMISTIC, // walls that have not been observed are treated as present
+};
+
 #define INVALID_DIRECTION (0)
-#define MAX_COST 255
+#define MAX_COST 0xFFFF
 
 extern const uint8_t emptyMaze[];
 extern const uint8_t japan2007[];
 
-extern uint8_t cost[256];
+extern uint16_t cost[256];
 extern uint8_t walls[256];
+extern uint8_t g_unseen_wall_mask;
 
 // tables give new direction from current heading and next turn
 const unsigned char DtoR[] = {1, 2, 3, 0};
 const unsigned char DtoB[] = {2, 3, 0, 1};
 const unsigned char DtoL[] = {3, 0, 1, 2};
 
+/***
+ * The bitboard flood keeps its own copy of the walls. Anything that
+ * changes walls[] directly, rather than through the wall functions below,
+ * must call this afterwards for each cell it changed.
+ */
+#if FLOOD_BITBOARD
+void refresh_wall_planes(uint8_t cell);
+#else
+inline void refresh_wall_planes(uint8_t cell) {
+}
+#endif
+
 inline void mark_cell_visited(uint8_t cell) {
   walls[cell] |= VISITED;
+  refresh_wall_planes(cell);
 }
 
 inline bool cell_is_visited(uint8_t cell) {
   return (walls[cell] & VISITED) == VISITED;
 }
 
+inline uint8_t observed_bit(uint8_t direction) {
+  return 0x10 << direction;
+}
+
+inline bool wall_is_observed(uint8_t cell, uint8_t direction) {
+  return (walls[cell] & observed_bit(direction)) != 0;
+}
+
+/***
+ * The walls that a flood cannot pass through. In the optimistic flood
+ * mode that is just the walls known to be present. In the pessimistic
+ * mode it includes the walls that have not yet been observed.
+ */
+inline uint8_t closed_walls(uint8_t cell) {
+  uint8_t wallData = walls[cell];
+  uint8_t unseen = (uint8_t)(~wallData) >> 4;
+  return (wallData | (unseen & g_unseen_wall_mask)) & 0x0F;
+}
+
 inline bool is_exit(uint8_t cell, uint8_t direction) {
-  return ((walls[cell] & (1 << direction)) == 0);
+  return ((closed_walls(cell) & (1 << direction)) == 0);
 }
 
 inline bool is_wall(uint8_t cell, uint8_t direction) {
   return ((walls[cell] & (1 << direction)) != 0);
 }
 
-void set_maze_goal(uint8_t goal_cell);
+void set_maze_goal(uint8_t goal_cell, uint8_t size = 1);
 uint8_t maze_goal();
+uint8_t maze_goal_size();
+bool is_goal(uint8_t cell);
 
 uint8_t cell_north(uint8_t cell);
 uint8_t cell_east(uint8_t cell);
 uint8_t cell_south(uint8_t cell);
 uint8_t cell_west(uint8_t cell);
 uint8_t neighbour(uint8_t cell, uint8_t direction);
-uint8_t neighbour_cost(uint8_t cell, uint8_t direction);
+uint16_t neighbour_cost(uint8_t cell, uint8_t direction);
 uint8_t direction_to_smallest(uint8_t cell, uint8_t startDirection);
 
 void copy_walls_from_flash(const uint8_t *src);
 
 void set_wall_present(uint8_t cell, uint8_t direction);
 void set_wall_absent(uint8_t cell, uint8_t direction);
+void mark_wall_observed(uint8_t cell, uint8_t direction);
+
+void set_flood_mode(FloodMode mode);
+FloodMode flood_mode();
+bool route_is_proven(uint8_t start, uint8_t target, uint8_t size = 1);
+uint8_t next_cell_to_explore(uint8_t from, uint8_t start, uint8_t destination, uint8_t destination_size);
 
 void initialise_maze(const uint8_t *testMaze);
-void flood_maze(uint8_t target);
+
+// a flood given one of these gives up as soon as it returns true
+typedef bool (*FloodStop)();
+
+bool flood_maze(uint8_t target, uint8_t size = 1, FloodStop stop = nullptr);
+bool flood_maze_queue(uint8_t target, uint8_t size = 1, FloodStop stop = nullptr);
+#if FLOOD_BITBOARD
+bool flood_maze_bitboard(uint8_t target, uint8_t size = 1, FloodStop stop = nullptr);
+#endif
+void flood_maze_goal();
+void flood_maze_weighted(uint8_t target, uint16_t straight_cost, uint16_t turn_cost, uint8_t size = 1);
+void flood_update_after_walls(uint8_t cell, uint8_t changed_mask);
 
 #endif //MAZE_H
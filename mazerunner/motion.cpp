@@ -32,10 +32,18 @@
 
 #include "motion.h"
 #include "motors.h"
+#include "path.h"
 #include "profile.h"
+#include "queue.h"
 #include "reports.h"
 #include "sensors.h"
 #include <Arduino.h>
+#include <util/atomic.h>
+
+static Queue<MotionCommand, MOTION_QUEUE_SIZE> s_motion_queue;
+static volatile bool s_motion_active = false;
+static volatile bool s_motion_triggered = false;
+static MotionCommand s_current_motion;
 
 //***************************************************************************//
 /*
@@ -50,16 +58,223 @@
  * Before the robot begins a sequence of moves, this method can be used to
  * make sure everything starts off in a known state.
  *
- * @brief Reset profiles, counters and controllers. Motors off. Steering off.
+ * @brief Reset profiles, counters and controllers. Motors off. Steering and edge correction off.
  */
 void reset_drive_system() {
   stop_motors();
   disable_motor_controllers();
   disable_steering();
+  disable_edge_correction();
+  set_steering_mode(STEER_ORTHOGONAL);
   reset_encoders();
   reset_motor_controllers();
   forward.reset();
   rotation.reset();
+  motion_clear();
+}
+
+//***************************************************************************//
+/**
+ * The motion queue lets a move made of several phases, like the run-in,
+ * rotation and run-out of a smooth turn, be handed over all at once.
+ * Systick starts each command on the tick that the one before it finishes
+ * so the phases join up exactly and the main program is free to get on
+ * with something else, like flooding the maze, while it waits.
+ *
+ * While the queue is busy, the main program should leave the profiles
+ * alone apart from reading them.
+ *
+ * A single move should never need more than MOTION_QUEUE_SIZE-1 commands.
+ * If the queue is full, the command is dropped and false is returned.
+ *
+ * @brief add a command to the end of the motion queue
+ */
+bool motion_enqueue(MotionType type, float distance, float top_speed, float final_speed, float acceleration, int trigger) {
+  MotionCommand command;
+  command.type = type;
+  command.trigger = trigger;
+  command.distance = distance;
+  command.top_speed = top_speed;
+  command.final_speed = final_speed;
+  command.acceleration = acceleration;
+  bool added;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (s_motion_queue.empty() and not s_motion_active) {
+      s_motion_triggered = false;
+    }
+    added = s_motion_queue.add(command);
+  }
+  return added;
+}
+
+/**
+ * @brief true when every queued command has finished
+ */
+bool motion_is_finished() {
+  bool finished;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    finished = s_motion_queue.empty() and not s_motion_active;
+  }
+  return finished;
+}
+
+/**
+ * The command that is running does not count so this can be used to wait
+ * for one phase of a move to finish while the next ones are still queued.
+ *
+ * @brief return the number of commands that have not been started
+ */
+uint8_t motion_commands_waiting() {
+  uint8_t waiting;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    waiting = s_motion_queue.size();
+  }
+  return waiting;
+}
+
+/**
+ * @brief true when there is no room for another command
+ */
+bool motion_queue_is_full() {
+  bool full;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    full = s_motion_queue.full();
+  }
+  return full;
+}
+
+/**
+ * @brief true if a forward move since the queue was last idle ended on its front sensor trigger
+ */
+bool motion_was_triggered() {
+  return s_motion_triggered;
+}
+
+/**
+ * Abandons any queued commands. The profiles carry on with whatever
+ * they were doing.
+ *
+ * @brief empty the motion queue
+ */
+void motion_clear() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    s_motion_queue.clear();
+    s_motion_active = false;
+  }
+}
+
+/**
+ * Called from systick after the profiles have been updated. If the current
+ * command has finished, the next one is started straight away.
+ *
+ * @brief advance the motion queue
+ */
+void update_motion() {
+  if (s_motion_active) {
+    bool done = false;
+    switch (s_current_motion.type) {
+      case MOVE_FORWARD:
+      case MOVE_DIAGONAL:
+        if (s_current_motion.trigger and g_front_wall_sensor > s_current_motion.trigger) {
+          forward.set_state(CS_FINISHED);
+          s_motion_triggered = true;
+        }
+        done = forward.is_finished();
+        break;
+      case MOVE_ROTATE:
+        done = rotation.is_finished();
+        break;
+      case MOVE_STOP:
+        done = forward.speed() == 0;
+        break;
+      default:
+        done = true;
+        break;
+    }
+    if (not done) {
+      return;
+    }
+    s_motion_active = false;
+  }
+  while (not s_motion_queue.empty()) {
+    s_current_motion = s_motion_queue.head();
+    const MotionCommand &m = s_current_motion;
+    switch (m.type) {
+      case MOVE_FORWARD:
+        set_steering_mode(STEER_ORTHOGONAL);
+        forward.start(m.distance, m.top_speed == 0 ? forward.speed() : m.top_speed, m.final_speed, m.acceleration);
+        break;
+      case MOVE_DIAGONAL:
+        set_steering_mode(STEER_DIAGONAL);
+        forward.start(m.distance, m.top_speed, m.final_speed, m.acceleration);
+        break;
+      case MOVE_ROTATE:
+        rotation.start(m.distance, m.top_speed, m.final_speed, m.acceleration);
+        break;
+      case MOVE_STOP:
+        forward.set_target_speed(0);
+        break;
+      case MOVE_SET_POSITION:
+        forward.set_position(m.distance);
+        continue;
+    }
+    s_motion_active = true;
+    break;
+  }
+}
+
+//***************************************************************************//
+/***
+ * The speed run turns in the same order as their path codes. An SS90 is
+ * PATH_RIGHT or PATH_LEFT in a path.
+ *
+ * The values are for right turns. They were worked out by stepping a
+ * Profile through the rotation one tick at a time, with its angular
+ * acceleration limited to SPEED_RUN_TURN_ALPHA, while the robot moves at
+ * the turn speed. For the SS180, omega is chosen so that the robot ends up
+ * in the next cell over. For the others, the turn only has to start and
+ * end on the right lines and omega just sets how far before the corner it
+ * starts.
+ *
+ * A rotation that reaches its braking point a tick early finishes at the
+ * 5 deg/s creep speed and can run 30mm wide, so each omega is one where
+ * that does not happen. Small changes to omega or to the turn speeds can
+ * upset that. Test 31 checks the whole table.
+ */
+static const TurnParameters s_turns[] PROGMEM = {
+    // run_in, run_out, angle, omega
+    {-69, -71, -90, 557},   // SS90
+    {0, 0, -180, 255},      // SS180
+    {-130, 23, -45, 479},   // SD45
+    {-9, 91, -135, 712},    // SD135
+    {24, -131, -45, 479},   // DS45
+    {92, -10, -135, 712},   // DS135
+    {8, 7, -90, 557},       // DD90
+};
+
+/**
+ * Returns false if the code is not a smooth turn.
+ *
+ * @brief look up how to run a speed run turn from its path code
+ */
+bool get_turn_parameters(uint8_t code, TurnParameters &turn) {
+  uint8_t op = path_op(code);
+  uint8_t index;
+  bool left;
+  if (op == PATH_RIGHT || op == PATH_LEFT) {
+    index = 0;
+    left = op == PATH_LEFT;
+  } else if (op >= PATH_SS180 && op <= PATH_DD90) {
+    index = ((op - PATH_SS180) >> 4) + 1;
+    left = code & PATH_TURN_LEFT;
+  } else {
+    return false;
+  }
+  memcpy_P(&turn, &s_turns[index], sizeof(TurnParameters));
+  if (left) {
+    turn.angle = -turn.angle;
+  }
+  return true;
 }
 
 //***************************************************************************//
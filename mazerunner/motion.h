@@ -35,8 +35,57 @@
 
 #include <Arduino.h>
 
+/***
+ * Motion commands are queued by the main program and started by systick
+ * as soon as the one before has finished so that there is no gap between
+ * the phases of a move.
+ */
+enum MotionType : uint8_t {
+  MOVE_FORWARD,      // forward.start() with the given parameters
+  MOVE_DIAGONAL,     // as MOVE_FORWARD but steering from posts on a diagonal
+  MOVE_ROTATE,       // rotation.start() with the given parameters
+  MOVE_STOP,         // bring the forward speed to zero
+  MOVE_SET_POSITION, // forward.set_position(distance) then carry on
+};
+
+struct MotionCommand {
+  MotionType type;
+  int trigger; // a forward move also ends if the front sensor gets above this. 0 for none
+  float distance;
+  float top_speed; // for a forward move, 0 means carry on at the current speed
+  float final_speed;
+  float acceleration;
+};
+
+#define MOTION_QUEUE_SIZE 8 // must be a power of two. holds one less than this
+
+/***
+ * The smooth turns used in a speed run are rotations made while the robot
+ * keeps moving forward at the turn speed from path_turn_speed(). The lines
+ * before and after each turn are measured to the reference points used in
+ * the path and run_in and run_out adjust them so that the rotation starts
+ * and ends in the right place.
+ */
+struct TurnParameters {
+  int16_t run_in;  // mm added to the line before the turn. Negative shortens it
+  int16_t run_out; // mm added to the line after the turn
+  int16_t angle;   // deg. Positive is to the left
+  int16_t omega;   // deg/s
+};
+
+#define SPEED_RUN_TURN_ALPHA 8000 // deg/s/s for all the speed run turns
+
 void reset_drive_system();
 
+bool motion_enqueue(MotionType type, float distance, float top_speed = 0, float final_speed = 0, float acceleration = 0, int trigger = 0);
+bool motion_is_finished();
+uint8_t motion_commands_waiting();
+bool motion_queue_is_full();
+bool motion_was_triggered();
+void motion_clear();
+void update_motion();
+bool get_turn_parameters(uint8_t code, TurnParameters &turn);
+
 void turn(float angle, float omega, float alpha);
 
 void stop_at(float distance);
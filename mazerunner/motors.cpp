@@ -31,6 +31,7 @@
  */
 
 #include "motors.h"
+#include "control.h"
 #include "digitalWriteFast.h"
 #include "encoders.h"
 #include "profile.h"
@@ -43,12 +44,17 @@ float g_left_motor_volts;
 float g_right_motor_volts;
 
 static bool s_controllers_output_enabled;
-static float s_old_fwd_error;
-static float s_old_rot_error;
-static float s_fwd_error;
-static float s_rot_error;
-Profile forward;
-Profile rotation;
+static control_t s_old_fwd_error;
+static control_t s_old_rot_error;
+static control_t s_fwd_error;
+static control_t s_rot_error;
+#if USE_SCURVE_PROFILES
+MotionProfile forward(FWD_JERK);
+MotionProfile rotation(ROT_JERK);
+#else
+MotionProfile forward;
+MotionProfile rotation;
+#endif
 
 void enable_motor_controllers() {
   s_controllers_output_enabled = true;
@@ -78,43 +84,45 @@ void setup_motors() {
   stop_motors();
 }
 
-float position_controller() {
-  s_fwd_error += forward.increment() - robot_fwd_increment();
-  float diff = s_fwd_error - s_old_fwd_error;
+/***
+ * The gains are converted from the settings every time so that changes
+ * made from the CLI take effect at once.
+ */
+control_t position_controller(control_t fwd_increment) {
+  s_fwd_error += fwd_increment - robot_fwd_increment();
+  control_t output = get_pd_output(s_fwd_error, s_old_fwd_error, control_t(settings.fwdKP), control_t(settings.fwdKD));
   s_old_fwd_error = s_fwd_error;
-  float output = settings.fwdKP * s_fwd_error + settings.fwdKD * diff;
   return output;
 }
 
-float angle_controller(float steering_adjustment) {
-  s_rot_error += rotation.increment() - robot_rot_increment();
+control_t angle_controller(control_t rot_increment, control_t steering_adjustment) {
+  s_rot_error += rot_increment - robot_rot_increment();
   if (g_steering_enabled) {
     s_rot_error += steering_adjustment;
   }
-  float diff = s_rot_error - s_old_rot_error;
+  control_t output = get_pd_output(s_rot_error, s_old_rot_error, control_t(settings.rotKP), control_t(settings.rotKD));
   s_old_rot_error = s_rot_error;
-  float output = settings.rotKP * s_rot_error + settings.rotKD * diff;
   return output;
 }
 
-void update_motor_controllers(float steering_adjustment) {
-  float pos_output = position_controller();
-  float rot_output = angle_controller(steering_adjustment);
-  float left_output = 0;
-  float right_output = 0;
+void update_motor_controllers(control_t steering_adjustment) {
+  control_t fwd_increment = forward.increment();
+  control_t rot_increment = rotation.increment();
+  control_t pos_output = position_controller(fwd_increment);
+  control_t rot_output = angle_controller(rot_increment, steering_adjustment);
+  control_t left_output;
+  control_t right_output;
+  get_feedforward(fwd_increment, rot_increment, left_output, right_output);
   left_output += pos_output;
   right_output += pos_output;
   left_output -= rot_output;
   right_output += rot_output;
-  float v_fwd = forward.speed();
-  float v_rot = rotation.speed();
-  float v_left = v_fwd - (PI / 180.0) * MOUSE_RADIUS * v_rot;
-  float v_right = v_fwd + (PI / 180.0) * MOUSE_RADIUS * v_rot;
-  left_output += SPEED_FF * v_left;
-  right_output += SPEED_FF * v_right;
   if (s_controllers_output_enabled) {
-    set_right_motor_volts(right_output);
-    set_left_motor_volts(left_output);
+    control_t battery_scale = g_battery_scale;
+    g_right_motor_volts = (float)constrain(right_output, control_t(-MAX_MOTOR_VOLTS), control_t(MAX_MOTOR_VOLTS));
+    g_left_motor_volts = (float)constrain(left_output, control_t(-MAX_MOTOR_VOLTS), control_t(MAX_MOTOR_VOLTS));
+    set_right_motor_pwm(get_motor_pwm(right_output, battery_scale));
+    set_left_motor_pwm(get_motor_pwm(left_output, battery_scale));
   }
 }
 /**
@@ -145,15 +153,13 @@ void set_right_motor_pwm(int pwm) {
 void set_left_motor_volts(float volts) {
   volts = constrain(volts, -MAX_MOTOR_VOLTS, MAX_MOTOR_VOLTS);
   g_left_motor_volts = volts;
-  int motorPWM = (int)(volts * g_battery_scale);
-  set_left_motor_pwm(motorPWM);
+  set_left_motor_pwm(get_motor_pwm(volts, (float)g_battery_scale));
 }
 
 void set_right_motor_volts(float volts) {
   volts = constrain(volts, -MAX_MOTOR_VOLTS, MAX_MOTOR_VOLTS);
   g_right_motor_volts = volts;
-  int motorPWM = (int)(volts * g_battery_scale);
-  set_right_motor_pwm(motorPWM);
+  set_right_motor_pwm(get_motor_pwm(volts, (float)g_battery_scale));
 }
 
 void set_motor_pwm_frequency(int frequency) {
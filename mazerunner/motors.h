@@ -34,6 +34,7 @@
 #define MOTORS_H
 
 // #include <Arduino.h>
+#include "fixed.h"
 
 extern float g_left_motor_volts;
 extern float g_right_motor_volts;
@@ -49,7 +50,7 @@ void reset_motor_controllers();
  * in a two-wheel differential drive robot.
  */
 
-void update_motor_controllers(float steering_adjustment);
+void update_motor_controllers(control_t steering_adjustment);
 
 enum { PWM_488_HZ,
        PWM_3906_HZ,
@@ -33,9 +33,13 @@
 #include "mouse.h"
 #include "Arduino.h"
 #include "encoders.h"
+#include "estimate.h"
 #include "maze.h"
 #include "motion.h"
 #include "motors.h"
+#include "path.h"
+#include "planner.h"
+#include "pose.h"
 #include "profile.h"
 #include "reports.h"
 #include "sensors.h"
@@ -43,8 +47,7 @@
 
 Mouse dorothy;
 
-char path[128];
-char commands[128];
+uint8_t path[PATH_LENGTH];
 char p_mouse_state __attribute__((section(".noinit")));
 
 static char dirLetters[] = "NESW";
@@ -66,6 +69,261 @@ void print_walls() {
     Serial.print('-');
   }
 }
+
+//***************************************************************************//
+/***
+ * Search targets are single cells except for the maze goal, which means
+ * the whole goal region. Waypoints are never goal cells so a flood to a
+ * goal cell only ever happens when the search is really going to the goal.
+ */
+static unsigned char target_size(unsigned char target) {
+  return (target == maze_goal()) ? maze_goal_size() : 1;
+}
+
+static void flood_to_target(unsigned char target) {
+  flood_maze(target, target_size(target));
+}
+
+/***
+ * Search decisions are worked out ahead of time.
+ *
+ * Once the mouse has chosen its way out of a cell, it knows which cell it
+ * will reach next and which way it will be facing. While it travels, the
+ * spare time in the busy-wait loops is used to flood the maze once for
+ * each pattern of left, front and right walls that the next cell might
+ * have, recording the way the mouse would leave it. Walls that have
+ * already been observed are not in doubt so a visited cell needs only
+ * one flood.
+ *
+ * At the sensing point the decision is then just a table lookup. If the
+ * lookup misses, perhaps because the mouse arrived before the work was
+ * finished, the search works it out there and then as before.
+ *
+ * The floods leave the cost array describing a map that does not exist
+ * so it must be flooded again before the costs are used for anything
+ * else.
+ */
+#define LOOKAHEAD_DONE 8  // all the wall patterns have been tried
+#define DECISION_NONE 0xFF // no direction could be looked up
+#define DECISION_STOP 0xFE // the cell is a target or is walled in
+
+struct Lookahead {
+  unsigned char cell;      // the cell the decisions are for
+  unsigned char heading;   // the way the mouse will be facing when it gets there
+  unsigned char target;    // the flood target used for the decisions
+  unsigned char pattern;   // the next wall pattern to try
+  unsigned char ready;     // bit n is set once choice[n] is valid
+  unsigned char choice[8]; // the direction to leave by for each wall pattern
+};
+
+static Lookahead s_lookahead = {0, 0, 0, LOOKAHEAD_DONE, 0, {0}};
+static bool s_costs_are_speculative = false;
+
+/***
+ * The three walls a mouse sees on entering a cell as a pattern with
+ * the left wall in bit 0, the front wall in bit 1 and the right wall
+ * in bit 2.
+ */
+static unsigned char wall_pattern_direction(unsigned char heading, unsigned char bit) {
+  switch (bit) {
+    case 0:
+      return DtoL[heading];
+    case 1:
+      return heading;
+    default:
+      return DtoR[heading];
+  }
+}
+
+/***
+ * Start working out the decisions for the given cell. Nothing is
+ * flooded here so it is safe to call just before the mouse moves.
+ */
+static void plan_ahead(unsigned char cell, unsigned char heading, unsigned char target) {
+  s_lookahead.cell = cell;
+  s_lookahead.heading = heading;
+  s_lookahead.target = target;
+  s_lookahead.pattern = 0;
+  s_lookahead.ready = 0;
+}
+
+static void stop_planning_ahead() {
+  s_lookahead.pattern = LOOKAHEAD_DONE;
+  s_lookahead.ready = 0;
+}
+
+/***
+ * Do one flood's worth of the outstanding lookahead work.
+ *
+ * Wall patterns that disagree with walls already observed are skipped
+ * without a flood. The walls of the cell and its neighbours are put back
+ * exactly as they were after each flood.
+ *
+ * A flood takes several milliseconds, which is a few mm at search speed,
+ * so the stop function is passed on to the flood. It returns true once
+ * the mouse has reached the sensing point and the flood then gives up.
+ * That pattern is tried again next time.
+ *
+ * Returns true if a flood was done so that the caller can skip its delay.
+ */
+static bool think_ahead(FloodStop stop) {
+  unsigned char cell = s_lookahead.cell;
+  unsigned char heading = s_lookahead.heading;
+  unsigned char knownMask = 0;
+  unsigned char knownWalls = 0;
+  for (unsigned char bit = 0; bit < 3; bit++) {
+    unsigned char direction = wall_pattern_direction(heading, bit);
+    if (wall_is_observed(cell, direction)) {
+      knownMask |= (1 << bit);
+      if (is_wall(cell, direction)) {
+        knownWalls |= (1 << bit);
+      }
+    }
+  }
+  while (s_lookahead.pattern < LOOKAHEAD_DONE) {
+    unsigned char pattern = s_lookahead.pattern++;
+    if ((pattern & knownMask) != knownWalls) {
+      continue;
+    }
+    unsigned char savedWalls[4];
+    unsigned char neighbours[3];
+    savedWalls[3] = walls[cell];
+    for (unsigned char bit = 0; bit < 3; bit++) {
+      unsigned char direction = wall_pattern_direction(heading, bit);
+      neighbours[bit] = neighbour(cell, direction);
+      savedWalls[bit] = walls[neighbours[bit]];
+      if (pattern & (1 << bit)) {
+        set_wall_present(cell, direction);
+      }
+    }
+    unsigned char target = s_lookahead.target;
+    bool finished = flood_maze(target, target_size(target), stop);
+    s_costs_are_speculative = true;
+    unsigned char choice = DECISION_STOP;
+    if (finished && cost[cell] != 0 && cost[cell] != MAX_COST) {
+      choice = direction_to_smallest(cell, heading);
+    }
+    for (unsigned char bit = 0; bit < 3; bit++) {
+      walls[neighbours[bit]] = savedWalls[bit];
+      refresh_wall_planes(neighbours[bit]);
+    }
+    walls[cell] = savedWalls[3];
+    refresh_wall_planes(cell);
+    if (not finished) {
+      s_lookahead.pattern = pattern;
+      return true;
+    }
+    s_lookahead.choice[pattern] = choice;
+    s_lookahead.ready |= (1 << pattern);
+    return true;
+  }
+  return false;
+}
+
+/***
+ * Once the map has been updated for the walls seen in a cell, find the
+ * direction worked out in advance for those walls.
+ *
+ * Returns DECISION_NONE if there is nothing to look up.
+ */
+static unsigned char look_up_decision(unsigned char cell, unsigned char heading, unsigned char target) {
+  if (cell != s_lookahead.cell || heading != s_lookahead.heading || target != s_lookahead.target) {
+    return DECISION_NONE;
+  }
+  unsigned char pattern = 0;
+  for (unsigned char bit = 0; bit < 3; bit++) {
+    if (is_wall(cell, wall_pattern_direction(heading, bit))) {
+      pattern |= (1 << bit);
+    }
+  }
+  if ((s_lookahead.ready & (1 << pattern)) == 0) {
+    return DECISION_NONE;
+  }
+  return s_lookahead.choice[pattern];
+}
+
+/***
+ * Make sure the cost array is correct for the real map after a cell has
+ * been mapped, using the repair when the lookahead has not disturbed it.
+ */
+static void restore_costs(unsigned char cell, unsigned char new_walls, unsigned char target) {
+  if (s_costs_are_speculative) {
+    flood_to_target(target);
+    s_costs_are_speculative = false;
+  } else {
+    flood_update_after_walls(cell, new_walls);
+  }
+}
+
+static float s_sensing_position;
+
+static bool reached_sensing_position() {
+  return forward.position() >= s_sensing_position;
+}
+
+/***
+ * A version of wait_until_position() that gets on with the lookahead
+ * while it waits.
+ */
+static void think_until_position(float position) {
+  s_sensing_position = position;
+  while (forward.position() < position) {
+    if (not think_ahead(reached_sensing_position)) {
+      delay(2);
+    }
+  }
+}
+
+/***
+ * Count the cells beyond the given one that a search heading in the given
+ * direction would pass straight through without learning anything new.
+ * They must already be visited and their costs must lead straight on.
+ * A cell with a cost of zero always ends the count so that arrival is
+ * still detected at the sensing point.
+ *
+ * The costs must be correct for this so, if the lookahead has disturbed
+ * them, the maze is flooded again first. That only happens when there is
+ * a visited cell ahead to be counted.
+ */
+static unsigned char known_cells_ahead(unsigned char cell, unsigned char heading, unsigned char target) {
+  unsigned char next = neighbour(cell, heading);
+  if (not cell_is_visited(next)) {
+    return 0;
+  }
+  if (s_costs_are_speculative) {
+    flood_to_target(target);
+    s_costs_are_speculative = false;
+  }
+  unsigned char count = 0;
+  while (count < MAZE_WIDTH && cell_is_visited(next)) {
+    uint16_t nextCost = cost[next];
+    if (nextCost == 0 || nextCost == MAX_COST || direction_to_smallest(next, heading) != heading) {
+      break;
+    }
+    count++;
+    next = neighbour(next, heading);
+  }
+  return count;
+}
+
+/***
+ * From the sensing point, run through the next cell and the given number
+ * of known cells beyond it as a single move. The mouse speeds up to
+ * SPEEDMAX_STRAIGHT and is back down to SPEEDMAX_EXPLORE at the sensing
+ * point for the first cell it does not know about, ready to turn if it
+ * needs to.
+ */
+static void run_straight_through(unsigned char cells) {
+  float distance = (cells + 1) * FULL_CELL + (FULL_CELL - 10.0) - forward.position();
+  motion_enqueue(MOVE_FORWARD, distance, SPEEDMAX_STRAIGHT, SPEEDMAX_EXPLORE, SEARCH_ACCELERATION);
+  motion_enqueue(MOVE_SET_POSITION, FULL_CELL - 10.0);
+  while (not motion_is_finished()) {
+    if (not think_ahead(motion_is_finished)) {
+      delay(2);
+    }
+  }
+}
+
 //***************************************************************************//
 /**
  * Used to bring the mouse to a halt, centred in a cell.
@@ -114,11 +372,11 @@ void turn_IP90L() {
 }
 
 void turnSS90L() {
-  turn(90, 200, 2000);
+  turn(90, SMOOTH_TURN_OMEGA, SMOOTH_TURN_ALPHA);
 }
 
 void turnSS90R() {
-  turn(-90, 200, 2000);
+  turn(-90, SMOOTH_TURN_OMEGA, SMOOTH_TURN_ALPHA);
 }
 
 void move_forward(float distance, float top_speed, float end_speed) {
@@ -171,31 +429,27 @@ void Mouse::turn_SS90ER() {
   float angle = -90.0;  // deg
   float omega = 280;    // deg/s
   float alpha = 4000;   // deg/s/s
-  bool triggered = false;
   disable_steering();
   float distance = FULL_CELL + 10.0 + run_in - forward.position();
-  forward.start(distance, forward.speed(), DEFAULT_TURN_SPEED, SEARCH_ACCELERATION);
-  while (not forward.is_finished()) {
+  motion_enqueue(MOVE_FORWARD, distance, forward.speed(), DEFAULT_TURN_SPEED, SEARCH_ACCELERATION, 54);
+  motion_enqueue(MOVE_ROTATE, angle, omega, 0, alpha);
+  // the run-out starts at whatever speed the run-in left the robot
+  motion_enqueue(MOVE_FORWARD, run_out, 0, DEFAULT_SEARCH_SPEED, SEARCH_ACCELERATION);
+  motion_enqueue(MOVE_SET_POSITION, FULL_CELL - 10.0);
+  // wait for the run-in to end so that the status is logged before the turn
+  while (motion_commands_waiting() > 2) {
     delay(2);
-    if (g_front_wall_sensor > 54) {
-      forward.set_state(CS_FINISHED);
-      triggered = true;
-    }
   }
-  if (triggered) {
+  if (motion_was_triggered()) {
     log_status('R');
   } else {
     log_status('r');
   }
-  rotation.start(angle, omega, 0, alpha);
-  while (not rotation.is_finished()) {
-    delay(2);
-  }
-  forward.start(run_out, forward.speed(), DEFAULT_SEARCH_SPEED, SEARCH_ACCELERATION);
-  while (not forward.is_finished()) {
-    delay(2);
+  while (not motion_is_finished()) {
+    if (not think_ahead(motion_is_finished)) {
+      delay(2);
+    }
   }
-  forward.set_position(FULL_CELL - 10.0);
 }
 
 void Mouse::turn_SS90EL() {
@@ -204,31 +458,27 @@ void Mouse::turn_SS90EL() {
   float angle = 90.0;   // deg
   float omega = 280;    // deg/s
   float alpha = 4000;   // deg/s/s
-  bool triggered = false;
   disable_steering();
   float distance = FULL_CELL + 10.0 + run_in - forward.position();
-  forward.start(distance, forward.speed(), DEFAULT_TURN_SPEED, SEARCH_ACCELERATION);
-  while (not forward.is_finished()) {
+  motion_enqueue(MOVE_FORWARD, distance, forward.speed(), DEFAULT_TURN_SPEED, SEARCH_ACCELERATION, 54);
+  motion_enqueue(MOVE_ROTATE, angle, omega, 0, alpha);
+  // the run-out starts at whatever speed the run-in left the robot
+  motion_enqueue(MOVE_FORWARD, run_out, 0, DEFAULT_SEARCH_SPEED, SEARCH_ACCELERATION);
+  motion_enqueue(MOVE_SET_POSITION, FULL_CELL - 10.0);
+  // wait for the run-in to end so that the status is logged before the turn
+  while (motion_commands_waiting() > 2) {
     delay(2);
-    if (g_front_wall_sensor > 54) {
-      forward.set_state(CS_FINISHED);
-      triggered = true;
-    }
   }
-  if (triggered) {
+  if (motion_was_triggered()) {
     log_status('L');
   } else {
     log_status('l');
   }
-  rotation.start(angle, omega, 0, alpha);
-  while (not rotation.is_finished()) {
-    delay(2);
-  }
-  forward.start(run_out, forward.speed(), DEFAULT_SEARCH_SPEED, SEARCH_ACCELERATION);
-  while (not forward.is_finished()) {
-    delay(2);
+  while (not motion_is_finished()) {
+    if (not think_ahead(motion_is_finished)) {
+      delay(2);
+    }
   }
-  forward.set_position(FULL_CELL - 10.0);
 }
 
 /**
@@ -260,12 +510,15 @@ void Mouse::turn_around() {
   }
   // Be sure robot has come to a halt.
   forward.stop();
-  spin_turn(-180, SPEEDMAX_SPIN_TURN, SPIN_TURN_ACCELERATION);
-  forward.start(HALF_CELL - 10.0, SPEEDMAX_EXPLORE, SPEEDMAX_EXPLORE, SEARCH_ACCELERATION);
-  while (not forward.is_finished()) {
-    delay(2);
+  rotation.reset();
+  motion_enqueue(MOVE_ROTATE, -180, SPEEDMAX_SPIN_TURN, 0, SPIN_TURN_ACCELERATION);
+  motion_enqueue(MOVE_FORWARD, HALF_CELL - 10.0, SPEEDMAX_EXPLORE, SPEEDMAX_EXPLORE, SEARCH_ACCELERATION);
+  motion_enqueue(MOVE_SET_POSITION, FULL_CELL - 10.0);
+  while (not motion_is_finished()) {
+    if (not think_ahead(motion_is_finished)) {
+      delay(2);
+    }
   }
-  forward.set_position(FULL_CELL - 10.0);
 }
 
 //***************************************************************************//
@@ -279,6 +532,8 @@ void Mouse::init() {
   disable_steering();
   location = 0;
   heading = NORTH;
+  pathEndCell = START;
+  pathEndHeading = NORTH;
   p_mouse_state = SEARCHING;
 }
 
@@ -312,7 +567,7 @@ void Mouse::follow_to(unsigned char target) {
   location = 0;
   heading = NORTH;
   initialise_maze(emptyMaze);
-  flood_maze(maze_goal());
+  flood_to_target(target);
   // wait_for_front_sensor();
   delay(1000);
   enable_sensors();
@@ -323,10 +578,12 @@ void Mouse::follow_to(unsigned char target) {
     delay(2);
   }
   forward.set_position(HALF_CELL);
+  set_pose_in_cell(location, heading, 0);
+  enable_edge_correction();
   Serial.println(F("Off we go..."));
   wait_until_position(FULL_CELL - 10);
   // at the start of this loop we are always at the sensing point
-  while (location != target) {
+  while (cost[location] != 0) {
     if (button_pressed()) {
       break;
     }
@@ -335,8 +592,8 @@ void Mouse::follow_to(unsigned char target) {
     enable_steering();
     location = neighbour(location, heading);
     update_sensors();
-    update_map();
-    flood_maze(maze_goal());
+    unsigned char new_walls = update_map();
+    flood_update_after_walls(location, new_walls);
     unsigned char newHeading = direction_to_smallest(location, heading);
     unsigned char hdgChange = (newHeading - heading) & 0x3;
     Serial.print(hdgChange);
@@ -344,7 +601,7 @@ void Mouse::follow_to(unsigned char target) {
     Serial.write('|');
     Serial.write(' ');
     log_status('.');
-    if (location == target) {
+    if (cost[location] == 0) {
       end_run();
     } else if (!leftWall) {
       turn_SS90EL();
@@ -401,6 +658,20 @@ void Mouse::report_status() {
   Serial.println();
 }
 
+/***
+ * While exploring, the search heads for the unvisited cells that could
+ * still be part of a better route from the start to the goal, in the
+ * order that makes the shortest trip to the target. Once there are none
+ * left it heads for the real target.
+ */
+static unsigned char choose_waypoint(unsigned char location, unsigned char target) {
+  unsigned char waypoint = next_cell_to_explore(location, START, target, target_size(target));
+  if (waypoint == location) {
+    waypoint = target;
+  }
+  return waypoint;
+}
+
 /***
  * The mouse is assumed to be centrally placed in a cell and may be
  * stationary. The current location is known and need not be any cell
@@ -410,21 +681,35 @@ void Mouse::report_status() {
  * the map.
  *
  * On execution, the mouse will search the maze until it reaches the
- * given target.
+ * given target. If that is the maze goal, the search ends in whichever
+ * goal cell is reached first.
  *
  * The maze is mapped as each cell is entered. Mapping happens even in
  * cells that have already been visited. Walls are only ever added, not
  * removed.
  *
+ * If explore is true, the mouse first heads for any unvisited cells that
+ * could still be part of a better route from the start to the goal, in
+ * the order that makes the shortest trip, and only then for the target.
+ * It does not stop at them.
+ *
  * It is possible for the mapping process to make the mouse think it
- * is walled in with no route to the target.
+ * is walled in with no route to the target. If that happens, the mouse
+ * stops in the cell where it found out.
+ *
+ * At the end it prints the furthest the mouse got past a sensing point
+ * before the search noticed it was there.
  *
  * Returns  0  if the search is successful
  *         -1 if the maze has no route to the target.
  */
-int Mouse::search_to(unsigned char target) {
-
-  flood_maze(target);
+int Mouse::search_to(unsigned char target, bool explore) {
+  set_flood_mode(OPTIMISTIC);
+  unsigned char waypoint = target;
+  if (explore) {
+    waypoint = choose_waypoint(location, target);
+  }
+  flood_to_target(waypoint);
   // wait_for_front_sensor();
   delay(1000);
   enable_sensors();
@@ -441,10 +726,22 @@ int Mouse::search_to(unsigned char target) {
     delay(2);
   }
   forward.set_position(HALF_CELL);
+  set_pose_in_cell(location, heading, 0);
+  enable_edge_correction();
   Serial.println(F("Off we go..."));
-  wait_until_position(FULL_CELL - 10);
+  plan_ahead(neighbour(location, heading), heading, waypoint);
+  think_until_position(FULL_CELL - 10);
   // TODO. the robot needs to start each iteration at the sensing point
-  while (location != target) {
+  // every target cell has a cost of zero so that is how arrival is detected
+  int result = 0;
+  bool arrived = (cost[location] == 0);
+  // how far past the sensing point the mouse got before it was noticed
+  float latest = 0;
+  while (not arrived) {
+    float past = forward.position() - (FULL_CELL - 10.0f);
+    if (past > latest) {
+      latest = past;
+    }
     if (button_pressed()) {
       break;
     }
@@ -453,25 +750,61 @@ int Mouse::search_to(unsigned char target) {
     enable_steering();
     location = neighbour(location, heading);
     update_sensors();
-    update_map();
-    flood_maze(target);
-    unsigned char newHeading = direction_to_smallest(location, heading);
+    unsigned char new_walls = update_map();
+    unsigned char decision = look_up_decision(location, heading, waypoint);
+    if (waypoint != target && cell_is_visited(waypoint)) {
+      decision = DECISION_NONE;
+    }
+    unsigned char newHeading;
+    if (decision < DECISION_STOP) {
+      newHeading = decision;
+    } else {
+      // nothing useful was worked out in advance so do it now
+      restore_costs(location, new_walls, waypoint);
+      if (waypoint != target) {
+        if (cost[location] == 0 || cost[location] == MAX_COST || cell_is_visited(waypoint)) {
+          waypoint = choose_waypoint(location, target);
+          flood_to_target(waypoint);
+        }
+      }
+      newHeading = direction_to_smallest(location, heading);
+    }
     unsigned char hdgChange = (newHeading - heading) & 0x3;
     Serial.print(hdgChange);
     Serial.write(' ');
     Serial.write('|');
     Serial.write(' ');
     log_status('.');
-    if (location == target) {
+    if (decision >= DECISION_STOP && (cost[location] == 0 || cost[location] == MAX_COST)) {
       end_run();
       heading = (heading + 2) & 0x03;
+      if (cost[location] == MAX_COST) {
+        result = -1; // walled in
+      }
+      break;
     } else {
-
+      unsigned char straight = 0;
+      if (hdgChange == 0) {
+        straight = known_cells_ahead(location, heading, waypoint);
+      }
+      unsigned char nextCell = neighbour(location, newHeading);
+      for (unsigned char i = 0; i < straight; i++) {
+        nextCell = neighbour(nextCell, newHeading);
+      }
+      plan_ahead(nextCell, newHeading, waypoint);
       switch (hdgChange) {
         case 0: // ahead
-          forward.adjust_position(-FULL_CELL);
-          log_status('F');
-          wait_until_position(FULL_CELL - 10);
+          if (straight > 0) {
+            log_status('S');
+            run_straight_through(straight);
+            for (unsigned char i = 0; i < straight; i++) {
+              location = neighbour(location, heading);
+            }
+          } else {
+            forward.adjust_position(-FULL_CELL);
+            log_status('F');
+            think_until_position(FULL_CELL - 10);
+          }
           log_status('x');
           break;
         case 1: // right
@@ -492,8 +825,19 @@ int Mouse::search_to(unsigned char target) {
       }
     }
   }
+  stop_planning_ahead();
+  if (s_costs_are_speculative) {
+    flood_to_target(waypoint);
+    s_costs_are_speculative = false;
+  }
   Serial.println();
-  Serial.println(F("Arrived!  "));
+  if (result == 0) {
+    Serial.println(F("Arrived!  "));
+  } else {
+    Serial.println(F("No route!  "));
+  }
+  Serial.print(F("Latest sensing point (mm): "));
+  Serial.println(latest);
   for (int i = 0; i < 4; i++) {
     disable_sensors();
     delay(250);
@@ -504,107 +848,117 @@ int Mouse::search_to(unsigned char target) {
 
   report_status();
   reset_drive_system();
-  return 0;
+  return result;
+}
+
+/***
+ * Wait for room in the motion queue then add a command to it.
+ */
+static void queue_motion(MotionType type, float distance, float top_speed = 0, float final_speed = 0, float acceleration = 0) {
+  while (motion_queue_is_full()) {
+    delay(2);
+  }
+  motion_enqueue(type, distance, top_speed, final_speed, acceleration);
+}
+
+/***
+ * Turn a planned segment into motion commands. Smooth turns are run with
+ * the robot still moving forward at the speed the straight before left it.
+ *
+ * The run is abandoned if the button is pressed.
+ */
+static bool run_segment(const PlannedSegment &segment) {
+  if (button_pressed()) {
+    return false;
+  }
+  TurnParameters turn;
+  switch (segment.type) {
+    case SEGMENT_STRAIGHT:
+      queue_motion(MOVE_FORWARD, segment.length, segment.top_speed, segment.exit_speed, SEARCH_ACCELERATION);
+      break;
+    case SEGMENT_DIAGONAL:
+      queue_motion(MOVE_DIAGONAL, segment.length, segment.top_speed, segment.exit_speed, SEARCH_ACCELERATION);
+      break;
+    case SEGMENT_TURN:
+      if (get_turn_parameters(segment.turn, turn)) {
+        float scale = segment.turn_scale;
+        queue_motion(MOVE_ROTATE, turn.angle, turn.omega * scale, 0, SPEED_RUN_TURN_ALPHA * scale * scale);
+      }
+      break;
+    case SEGMENT_SPIN_LEFT:
+      queue_motion(MOVE_STOP, 0);
+      queue_motion(MOVE_ROTATE, 90, SPEEDMAX_SPIN_TURN, 0, SPIN_TURN_ACCELERATION);
+      break;
+    case SEGMENT_SPIN_RIGHT:
+      queue_motion(MOVE_STOP, 0);
+      queue_motion(MOVE_ROTATE, -90, SPEEDMAX_SPIN_TURN, 0, SPIN_TURN_ACCELERATION);
+      break;
+  }
+  return true;
+}
+
+/***
+ * Assume the maze is flooded and that a path has been generated. The path
+ * goes through the velocity planner and the planned segments are queued
+ * for systick to run back to back so the robot does not stop between them
+ * except to spin.
+ */
+static void run_path(const uint8_t *codes, bool smoothTurns, int topSpeed) {
+  Serial.print(F("Estimated run time: "));
+  Serial.println(estimate_run_time(codes, smoothTurns, topSpeed, SEARCH_ACCELERATION), 2);
+  enable_edge_correction();
+  if (not plan_path(codes, smoothTurns, topSpeed, SEARCH_ACCELERATION, run_segment)) {
+    Serial.println(F("Speed run abandoned"));
+    motion_clear();
+    forward.stop();
+    return;
+  }
+  while (not motion_is_finished()) {
+    delay(2);
+  }
 }
 
 //--------------------------------------------------------------------------
 // assume the maze is flooded and that a simple path string has been generated
 // then run the mouse along the path.
-// run-length encoding of straights is done on the fly.
-// turns are in-place so the mouse stops after each straight.
+// turns are in-place so the mouse stops for each one.
 //--------------------------------------------------------------------------
-void Mouse::run_in_place_turns(int topSpeed) { // TODO
-  expand_path(path);
-  // debug << path << endl;
-  // debug << commands << endl;
-  // "HRH": in place right
-  // "HLH": in place left
-  // "HH":  half a cell forward
-  // "HS":  end after half a cell
-  int index = 0;
-  while (commands[index] != 'S') {
-    if (button_pressed()) {
-      break;
-    }
-    if (commands[index] == 'B') {
-      index++;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'R' && commands[index + 2] == 'H') {
-
-      move_forward(HALF_CELL, topSpeed, 0);
-      turn_IP90R();
-      move_forward(HALF_CELL, topSpeed, topSpeed);
-      index += 3;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'L' && commands[index + 2] == 'H') {
-      move_forward(HALF_CELL, topSpeed, 0);
-      turn_IP90L();
-      move_forward(HALF_CELL, topSpeed, topSpeed);
-      index += 3;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'H') {
-      move_forward(HALF_CELL, topSpeed, topSpeed);
-      index++;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'S') {
-      move_forward(HALF_CELL, topSpeed, 0);
-      index++;
-    } else {
-      // debug << F("Instruction error!\n");
-      break;
-    }
-  }
+void Mouse::run_in_place_turns(int topSpeed) {
+  run_path(path, false, topSpeed);
   // assume we succeed
-  location = maze_goal();
+  location = pathEndCell;
+  heading = pathEndHeading;
   report_status();
 }
 
 //--------------------------------------------------------------------------
-// Assume the maze is flooded and that a path string already exists.
-// Convert that to half-cell straights for easier processing
-// next, convert all HRH and HLH occurrences to the corresponding smooth turns
-// then run the mouse along the path.
-// run-length encoding of straights is done on the fly.
-// turns are smooth and care is taken to deal with the path end.
+// Assume the maze is flooded and that a path already exists.
+// then run the mouse along the path with smooth turns.
+// care is taken to deal with the path end.
 //--------------------------------------------------------------------------
 void Mouse::run_smooth_turns(int topSpeed) {
-  expand_path(path);
-  // "HRH": smooth right
-  // "HLH": smooth left
-  // "HH":  half a cell forward
-  // "HS":  end after half a cell
-  int index = 0;
-  while (commands[index] != 'S') {
-    if (button_pressed()) {
-      break;
-    }
-    if (commands[index] == 'B') {
-      index++;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'R' && commands[index + 2] == 'H') {
-      move_forward(20, topSpeed, SPEEDMAX_SMOOTH_TURN);
-      // debug << 'R';
-      turnSS90R();
-      move_forward(20, topSpeed, topSpeed);
-      index += 3;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'L' && commands[index + 2] == 'H') {
-      move_forward(20, topSpeed, SPEEDMAX_SMOOTH_TURN);
-      // debug << 'L';
-      turnSS90L();
-      move_forward(20, topSpeed, topSpeed);
-      index += 3;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'H') {
-      // debug << 'H';
-      move_forward(HALF_CELL, topSpeed, topSpeed);
-      ;
-      index++;
-    } else if (commands[index] == 'H' && commands[index + 1] == 'S') {
-      // debug << 'H';
-      move_forward(HALF_CELL, topSpeed, 0);
-      index++;
-    } else {
-      // debug << F("Instruction error!\n");
-      break;
-    }
+  run_path(path, true, topSpeed);
+  // assume we succeed
+  location = pathEndCell;
+  heading = pathEndHeading;
+  report_status();
+}
+
+//--------------------------------------------------------------------------
+// Assume the maze is flooded and that a path already exists.
+// compile the path so that zig-zags are run on the diagonal then run it
+// with smooth turns. If the path cannot be compiled it is run as it is.
+//--------------------------------------------------------------------------
+void Mouse::run_diagonals(int topSpeed) {
+  uint8_t compiled[PATH_LENGTH];
+  if (path_compile_diagonals(path, compiled, PATH_LENGTH)) {
+    run_path(compiled, true, topSpeed);
+  } else {
+    run_path(path, true, topSpeed);
   }
-  // debug << 'S' << endl;
   // assume we succeed
-  location = maze_goal();
+  location = pathEndCell;
+  heading = pathEndHeading;
   report_status();
 }
 
@@ -662,57 +1016,80 @@ void Mouse::turn_to_face(unsigned char newHeading) {
   heading = newHeading;
 }
 
-void Mouse::update_map() {
-  switch (heading) {
-    case NORTH:
-      if (frontWall) {
-        set_wall_present(location, NORTH);
-      }
-      if (rightWall) {
-        set_wall_present(location, EAST);
-      }
-      if (leftWall) {
-        set_wall_present(location, WEST);
-      }
-      break;
-    case EAST:
-      if (frontWall) {
-        set_wall_present(location, EAST);
-      }
-      if (rightWall) {
-        set_wall_present(location, SOUTH);
-      }
-      if (leftWall) {
-        set_wall_present(location, NORTH);
-      }
-      break;
-    case SOUTH:
-      if (frontWall) {
-        set_wall_present(location, SOUTH);
-      }
-      if (rightWall) {
-        set_wall_present(location, WEST);
-      }
-      if (leftWall) {
-        set_wall_present(location, EAST);
-      }
-      break;
-    case WEST:
-      if (frontWall) {
-        set_wall_present(location, WEST);
-      }
-      if (rightWall) {
-        set_wall_present(location, NORTH);
-      }
-      if (leftWall) {
-        set_wall_present(location, SOUTH);
-      }
-      break;
-    default:
-      // This is an error. We should handle it.
+/***
+ * Record what the sensors saw for one wall of a cell. A wall that is seen
+ * is always added. Walls are never removed during a search so, if no wall
+ * is seen, it is only marked as observed. That also means the boundary
+ * walls, which are always present, are never touched.
+ */
+static void update_wall(unsigned char cell, unsigned char direction, bool wallSeen) {
+  if (wallSeen) {
+    set_wall_present(cell, direction);
+  } else if (not is_wall(cell, direction)) {
+    mark_wall_observed(cell, direction);
+  }
+}
+
+/***
+ * Add any walls seen by the sensors to the map of the current cell.
+ *
+ * The walls that are not seen are marked as observed, as is the wall
+ * behind since the mouse has just come through it.
+ *
+ * Returns a mask with bit n set for each wall in direction n that was not
+ * already in the map. That lets the caller repair the flood rather than
+ * recalculate it from scratch.
+ */
+unsigned char Mouse::update_map() {
+  unsigned char old_walls = walls[location] & 0x0F;
+  update_wall(location, heading, frontWall);
+  update_wall(location, DtoR[heading], rightWall);
+  update_wall(location, DtoL[heading], leftWall);
+  mark_wall_observed(location, DtoB[heading]);
+  mark_cell_visited(location);
+  return (walls[location] & 0x0F) & ~old_walls;
+}
+
+/***
+ * The mouse is expected to be in the start cell.
+ *
+ * Search to the goal and back to the start until the best route is known
+ * or MAX_SEARCH_PASSES round trips have been made. Apart from the very
+ * first run to the goal, the mouse explores on the way any cells that
+ * might still be part of a better route. Usually the first trip back to
+ * the start is enough to prove it.
+ *
+ * After each round trip, the maze is flooded once with every unobserved
+ * wall treated as absent and once with every unobserved wall treated as
+ * present. When the two give the same cost from the start, the best route
+ * that could possibly exist is already known to be open so there is no
+ * point in searching any more.
+ *
+ * If the passes run out first, there will still be a route through
+ * observed walls but it may not be the best one.
+ *
+ * Returns  0  if every search was successful
+ *         -1 if the maze has no route to a target.
+ */
+int Mouse::search_until_proven() {
+  for (int pass = 0; pass < MAX_SEARCH_PASSES; pass++) {
+    int result = search_to(maze_goal(), pass > 0);
+    if (result != 0) {
+      return result;
+    }
+    //  EEPROM.put(0, walls);
+    delay(200);
+    result = search_to(START, true);
+    if (result != 0) {
+      return result;
+    }
+    if (route_is_proven(START, maze_goal(), maze_goal_size())) {
+      Serial.println(F("Route proven"));
       break;
+    }
+    delay(200);
   }
-  walls[location] |= VISITED;
+  return 0;
 }
 
 /***
@@ -720,16 +1097,8 @@ void Mouse::update_map() {
  * The maze may, or may not, have been searched.
  * There may, or may not, be a solution.
  *
- * This simple searcher will just search to goal, turn around and
- * search back to the start. At that point there will be a route
- * but it is unlikely to be optimal.
- *
- * the mouse can run this route by creating a path that does not
- * pass through unvisited cells.
- *
- * A better searcher will continue until a path generated through all
- * cells, regardless of visited state,  does not pass through any
- * unvisited cells.
+ * The mouse searches out and back until the best route is proven, as
+ * described in search_until_proven().
  *
  * The walls can be saved to EEPROM after each pass. It left to the
  * reader as an exercise to do something useful with that.
@@ -739,14 +1108,7 @@ int Mouse::search_maze() {
   //                                             motorsEnable();
   location = 0;
   heading = NORTH;
-  int result = search_to(maze_goal());
-  if (result != 0) {
-    panic(1);
-  }
-  //  EEPROM.put(0, walls);
-  // digitalWrite(RED_LED, 1);
-  delay(200);
-  result = search_to(0);
+  int result = search_until_proven();
   stop_motors();
   if (result != 0) {
     panic(1);
@@ -756,6 +1118,53 @@ int Mouse::search_maze() {
   return 0;
 }
 
+/***
+ * Flood the maze so that make_path() will find the quickest route to the
+ * target rather than the one with the fewest cells.
+ *
+ * The costs are estimated times in units of 2ms. A cell
+ * entered after a turn is taken at SPEEDMAX_SMOOTH_TURN. On a straight,
+ * the mouse is allowed one cell of acceleration from the turn speed, up to
+ * SPEEDMAX_STRAIGHT. That underestimates the gain on long straights but it
+ * is enough to prefer them over a staircase of the same length.
+ *
+ * Only walls that have been observed to be absent are treated as open so
+ * the route is safe to run at speed. A later search_to() puts the flood
+ * mode back to OPTIMISTIC.
+ *
+ * The search proves the route with the manhattan flood, which counts
+ * cells, so the quickest route is only used if it is proven as well. That
+ * is when the same weighted flood from the start costs no more with the
+ * walls that are known than with every unseen wall open. Otherwise the
+ * flood is the manhattan one, through known walls, and the mouse runs the
+ * route that the search proved.
+ *
+ * Returns true if the costs are for the quickest route
+ */
+bool flood_for_speed_run(unsigned char target) {
+  float turnSpeed = SPEEDMAX_SMOOTH_TURN;
+  float straightSpeed = sqrt(turnSpeed * turnSpeed + 2.0f * SEARCH_ACCELERATION * FULL_CELL);
+  if (straightSpeed > SPEEDMAX_STRAIGHT) {
+    straightSpeed = SPEEDMAX_STRAIGHT;
+  }
+  // fixed units, rather than ticks, keep the cost of a long route within
+  // 16 bits whatever the loop frequency
+  const float COSTS_PER_SECOND = 500;
+  uint16_t straightCost = (uint16_t)(FULL_CELL / straightSpeed * COSTS_PER_SECOND + 0.5f);
+  uint16_t turnCost = (uint16_t)(FULL_CELL / turnSpeed * COSTS_PER_SECOND + 0.5f);
+  uint8_t size = target_size(target);
+  set_flood_mode(OPTIMISTIC);
+  flood_maze_weighted(target, straightCost, turnCost, size);
+  uint16_t possible = cost[START];
+  set_flood_mode(PESSIMISTIC);
+  flood_maze_weighted(target, straightCost, turnCost, size);
+  if (cost[START] != MAX_COST && cost[START] <= possible) {
+    return true;
+  }
+  flood_maze(target, size);
+  return false;
+}
+
 /***
  * Search the maze until there is a solution then make a path and run it
  * First with in-place turns, then with smooth turns;
@@ -763,10 +1172,12 @@ int Mouse::search_maze() {
  * The mouse can be placed into any of the possible states before
  * calling this function so that individual actions can be tested.
  *
- * If you do not want to search exhaustively then do a single search
- * out and back again. Then block off all the walls in any cells that
- * are unvisited. Now any path generated will succeed even if it is
- * not optimal.
+ * The search stops as soon as the best route is proven. The speed runs
+ * use a pessimistic flood that treats unobserved walls as present so any
+ * path generated will succeed even if the search ran out of passes before
+ * the route was proven. If the search fails, or make_path() cannot find a
+ * solved path to the goal, the mouse stops rather than run it and -1 is
+ * returned.
  */
 int Mouse::run_maze() {
   // motorsEnable();
@@ -776,15 +1187,23 @@ int Mouse::run_maze() {
     enable_steering();
     location = 0;
     heading = NORTH;
-    search_to(maze_goal());
-    search_to(START);
+    int result = search_until_proven();
+    if (result != 0) {
+      Serial.println(F("Search failed"));
+      stop_motors();
+      return result;
+    }
     turn_to_face(NORTH);
     delay(200);
     p_mouse_state = INPLACE_RUN;
   }
   if (p_mouse_state == INPLACE_RUN) {
-    flood_maze(maze_goal());
-    make_path(location);
+    flood_for_speed_run(maze_goal());
+    if (not make_path(location)) {
+      Serial.println(F("No solved path"));
+      stop_motors();
+      return -1;
+    }
     wait_for_front_sensor();
     Serial.println(F("Running in place"));
     run_in_place_turns(SPEEDMAX_STRAIGHT);
@@ -795,8 +1214,12 @@ int Mouse::run_maze() {
   }
   if (p_mouse_state == SMOOTH_RUN) {
     // now try with smooth turns;
-    flood_maze(maze_goal());
-    make_path(location);
+    flood_for_speed_run(maze_goal());
+    if (not make_path(location)) {
+      Serial.println(F("No solved path"));
+      stop_motors();
+      return -1;
+    }
     turn_to_face(direction_to_smallest(location, heading));
     delay(200);
     wait_for_front_sensor();
@@ -804,6 +1227,24 @@ int Mouse::run_maze() {
     run_smooth_turns(SPEEDMAX_STRAIGHT);
     Serial.println(F("Returning"));
     search_to(START);
+    Serial.println(F("Done"));
+    p_mouse_state = DIAGONAL_RUN;
+  }
+  if (p_mouse_state == DIAGONAL_RUN) {
+    // and finally cut across the zig-zags
+    flood_for_speed_run(maze_goal());
+    if (not make_path(location)) {
+      Serial.println(F("No solved path"));
+      stop_motors();
+      return -1;
+    }
+    turn_to_face(direction_to_smallest(location, heading));
+    delay(200);
+    wait_for_front_sensor();
+    Serial.println(F("Running diagonals"));
+    run_diagonals(SPEEDMAX_STRAIGHT);
+    Serial.println(F("Returning"));
+    search_to(START);
     Serial.println(F("Finished"));
     p_mouse_state = FINISHED;
   }
@@ -814,9 +1255,19 @@ int Mouse::run_maze() {
 /***
  * Assumes the maze is already flooded to a single target cell and so
  * every cell will have a cost that decreases as the target is approached.
+ * Either the manhattan flood or the weighted flood from
+ * flood_for_speed_run() can be used since only the order of the costs
+ * matters.
  *
  * Starting at the given cell, the algorithm repeatedly looks for the
  * smallest available neighbour and records the action taken to reach it.
+ * If there are several, the order of preference is ahead, right, left
+ * and then behind.
+ *
+ * The path ends in the first cell with a cost of zero. When the flood
+ * was to the goal region, that can be any one of the goal cells. The
+ * cell and the heading there are stored in pathEndCell and pathEndHeading
+ * so that the mouse knows where it is after running the path.
  *
  * The process starts by assuming the mouse is heading NORTH in the start
  * cell since that is what would be the case at the start of a speed run.
@@ -827,9 +1278,11 @@ int Mouse::run_maze() {
  * turn to face to the smallest neighbour of that cell using the same
  * method as in this function.
  *
- * The resulting path is a simple string, null terminated, that can be
- * printed to the Serial.to make it easy to compare paths using different
- * flooding or path generating methods.
+ * The resulting path is stored in path[] as compact byte codes, described
+ * in path.h, with straights counted in half cells. For printing, and to make
+ * it easy to compare paths using different flooding or path generating
+ * methods, it is converted to a simple path string with print_path() or
+ * path_to_text().
  *
  * The characters in the path string are:
  * 	'B' : always the first character, it marks the path start.
@@ -841,13 +1294,13 @@ int Mouse::run_maze() {
  * 	'S' : the last character in the path, telling the mouse to stop
  *
  * For example, the Japan2007 maze, flooded with a simple Manhattan
- * flood, should produce the path string:
+ * flood to the four cell goal, should produce the path string:
  *
- * BFFFRLLRRLLRRLLRFFRRFLLFFLRFRRLLRRLLRFFFFFFFFFRFFFFFRLRLLRRLLRRFFRFFFLFFFS
+ * BFFFRLLRRLLRRLLRFFRRFLLFFLRFRRLLRRLLRFFFFFFFFFRFFFFFRLRLLRRLLRRFFRFFFLFFS
  *
- * The path string is processed by the mouse directly to make it move
- * along the path. At its simplest, this is just a case of executing
- * a single movement for each character in the string, using in-place turns.
+ * The path is processed by the mouse directly to make it move along the
+ * path. At its simplest, this is just a case of executing a single movement
+ * for each byte code, using in-place turns.
  *
  * I would strongly recommend this style of path string. Not only can the
  * strings be used to compare routes very easily, they can be printed and
@@ -865,175 +1318,37 @@ int Mouse::run_maze() {
  *
  */
 
+// path operations indexed by the change in heading
+static const PathOp pathTurns[] = {PATH_STRAIGHT, PATH_RIGHT, PATH_AROUND, PATH_LEFT};
+
 bool Mouse::make_path(unsigned char startCell = START) {
   bool solved = true;
-  ;
   unsigned char cell = startCell;
-  int nextCost = cost[cell] - 1; // assumes manhattan flood
-  unsigned char commandIndex = 0;
-  path[commandIndex++] = 'B';
+  unsigned char length = 0;
   unsigned char direction = direction_to_smallest(cell, NORTH);
-  while (nextCost >= 0) {
-    unsigned char cmd = 'S';
-    switch (direction) {
-      case NORTH:
-        if (is_exit(cell, NORTH) && neighbour_cost(cell, NORTH) == nextCost) {
-          cmd = 'F';
-          break;
-        }
-        if (is_exit(cell, EAST) && neighbour_cost(cell, EAST) == nextCost) {
-          cmd = 'R';
-          direction = DtoR[direction];
-          break;
-        }
-        if (is_exit(cell, WEST) && neighbour_cost(cell, WEST) == nextCost) {
-          cmd = 'L';
-          direction = DtoL[direction];
-          break;
-        }
-        if (is_exit(cell, SOUTH) && neighbour_cost(cell, SOUTH) == nextCost) {
-          cmd = 'A';
-          direction = DtoB[direction];
-        }
-        break;
-      case EAST:
-        if (is_exit(cell, EAST) && neighbour_cost(cell, EAST) == nextCost) {
-          cmd = 'F';
-          break;
-        }
-        if (is_exit(cell, SOUTH) && neighbour_cost(cell, SOUTH) == nextCost) {
-          cmd = 'R';
-          direction = DtoR[direction];
-          break;
-        }
-        if (is_exit(cell, NORTH) && neighbour_cost(cell, NORTH) == nextCost) {
-          cmd = 'L';
-          direction = DtoL[direction];
-          break;
-        }
-        if (is_exit(cell, WEST) && neighbour_cost(cell, WEST) == nextCost) {
-          cmd = 'A';
-          direction = DtoB[direction];
-          break;
-        }
-        break;
-      case SOUTH:
-        if (is_exit(cell, SOUTH) && neighbour_cost(cell, SOUTH) == nextCost) {
-          cmd = 'F';
-          break;
-        }
-        if (is_exit(cell, WEST) && neighbour_cost(cell, WEST) == nextCost) {
-          direction = DtoR[direction];
-          cmd = 'R';
-          break;
-        }
-        if (is_exit(cell, EAST) && neighbour_cost(cell, EAST) == nextCost) {
-          cmd = 'L';
-          direction = DtoL[direction];
-          break;
-        }
-        if (is_exit(cell, NORTH) && neighbour_cost(cell, NORTH) == nextCost) {
-          cmd = 'A';
-          direction = DtoB[direction];
-          break;
-        }
-        break;
-      case WEST:
-        if (is_exit(cell, WEST) && neighbour_cost(cell, WEST) == nextCost) {
-          cmd = 'F';
-          break;
-        }
-        if (is_exit(cell, NORTH) && neighbour_cost(cell, NORTH) == nextCost) {
-          cmd = 'R';
-          direction = DtoR[direction];
-          break;
-        }
-        if (is_exit(cell, SOUTH) && neighbour_cost(cell, SOUTH) == nextCost) {
-          cmd = 'L';
-          direction = DtoL[direction];
-          break;
-        }
-        if (is_exit(cell, EAST) && neighbour_cost(cell, EAST) == nextCost) {
-          cmd = 'A';
-          direction = DtoB[direction];
-          break;
-        }
-        break;
-      default:
-        // this is an error. We should handle it.
-        break;
+  while (cost[cell] > 0) {
+    unsigned char newDirection = direction_to_smallest(cell, direction);
+    if (neighbour_cost(cell, newDirection) >= cost[cell] || length >= PATH_LENGTH - 3) {
+      solved = false; // no way to the target or the path will not fit
+      break;
     }
-    cell = neighbour(cell, direction);
-    if ((walls[cell] & VISITED) != VISITED) {
+    PathOp turn = pathTurns[(newDirection - direction) & 0x03];
+    if (turn != PATH_STRAIGHT) {
+      path_add_op(path, length, PATH_LENGTH, turn);
+    }
+    path_add_straight(path, length, PATH_LENGTH, 2);
+    if (not wall_is_observed(cell, newDirection)) {
       solved = false;
     }
-    nextCost--;
-    path[commandIndex] = cmd;
-    commandIndex++;
+    direction = newDirection;
+    cell = neighbour(cell, direction);
   }
-  path[commandIndex] = 'S';
-  commandIndex++;
-  path[commandIndex] = '\0';
+  path_add_op(path, length, PATH_LENGTH, PATH_STOP);
+  pathEndCell = cell;
+  pathEndHeading = direction;
   return solved;
 }
 
-/***
- * Assumes that the maze is flooded and a path string has been generated.
- *
- * Convert  the simple path string to a set of commands using half-cell
- * moves instead of full-cell moves so that a sequence like
- * 		BFRFLS
- * becomes
- * 		BHHRHHHHLHHS
- *
- * The turns all have an implied full cell forward movement after them
- * The only real advantage of this is that it is easier to convert to smooth
- * turns by looking for patterns like HRH and HLH
- *
-
- */
-void Mouse::expand_path(char *pathString) {
-  int pathIndex = 0;
-  int commandIndex = 0;
-  commands[commandIndex++] = 'B';
-  while (char c = pathString[pathIndex]) {
-    switch (c) {
-      case 'F':
-        commands[commandIndex++] = 'H';
-        commands[commandIndex++] = 'H';
-        pathIndex++;
-        break;
-      case 'R':
-        commands[commandIndex++] = 'R';
-        commands[commandIndex++] = 'H';
-        commands[commandIndex++] = 'H';
-        pathIndex++;
-        break;
-      case 'L':
-        commands[commandIndex++] = 'L';
-        commands[commandIndex++] = 'H';
-        commands[commandIndex++] = 'H';
-        pathIndex++;
-        break;
-      case 'S':
-        commands[commandIndex++] = 'S';
-        pathIndex++;
-        break;
-      case 'B':
-      case ' ': // ignore these so we can write easy-to-read path strings
-        pathIndex++;
-        break;
-      default:
-        // TODO: this is an error. We should handle it.
-        break;
-    }
-  }
-  commands[commandIndex] = '\0';
-}
-
 void Mouse::print_path() {
-  for (int i = 0; i < 128 && path[i]; i++) {
-    Serial.print(path[i]);
-  }
-  Serial.println();
+  print_path_text(path);
 }
@@ -33,19 +33,31 @@
 #ifndef MOUSE_H
 #define MOUSE_H
 
+#include <stdint.h>
+
 #define SEARCH_ACCELERATION 3000
 #define SPIN_TURN_ACCELERATION 3600
 #define SPEEDMAX_EXPLORE 400
 #define SPEEDMAX_STRAIGHT 800
 #define SPEEDMAX_SMOOTH_TURN 500
+#define SPEEDMAX_TIGHT_TURN 400 // 180 and 135 degree turns and the DD90
+#define SPEEDMAX_DIAGONAL 600
 #define SPEEDMAX_SPIN_TURN 360
+#define SMOOTH_TURN_OMEGA 200  // deg/s
+#define SMOOTH_TURN_ALPHA 2000 // deg/s/s
+
+#define PATH_LENGTH 128 // bytes of byte code path
+#define MAX_SEARCH_PASSES 4 // round trips from start to goal
 
+// p_mouse_state survives a reset so new stages go on the end to keep
+// the values of the existing ones
 enum {
   FRESH_START,
   SEARCHING,
   INPLACE_RUN,
   SMOOTH_RUN,
-  FINISHED
+  FINISHED,
+  DIAGONAL_RUN
 };
 
 /// TODO: should the whole mouse object be persistent?
@@ -62,15 +74,16 @@ class Mouse {
   void turn_SS90ER();
   void turn_around();
   void end_run();
-  int search_to(unsigned char target);
+  int search_to(unsigned char target, bool explore = false);
   void follow_to(unsigned char target);
   void run_in_place_turns(int top_speed);
   void run_smooth_turns(int top_speed);
-  void update_map();
+  void run_diagonals(int top_speed);
+  unsigned char update_map();
+  int search_until_proven();
   int search_maze();
   int run_maze();
   bool make_path(unsigned char startCell);
-  void expand_path(char *pathString);
   void print_path();
 
   unsigned char heading;
@@ -79,13 +92,16 @@ class Mouse {
   bool frontWall;
   bool rightWall;
   bool handStart;
+  unsigned char pathEndCell;
+  unsigned char pathEndHeading;
 };
 
 extern char p_mouse_state;
 
-extern char path[];
-extern char commands[];
+extern uint8_t path[];
 
 extern Mouse dorothy;
 
+bool flood_for_speed_run(unsigned char target);
+
 #endif //MOUSE_H
\ No newline at end of file
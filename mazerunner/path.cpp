@@ -0,0 +1,446 @@
+/*
+ * File: path.cpp
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:18:13 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:21:26 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "path.h"
+#include "mouse.h"
+#include <Arduino.h>
+
+//***************************************************************************//
+/*
+ * A path is built one operation at a time into a byte array of a given
+ * size. The length is the number of bytes used so far and is updated by
+ * each call. Every add function returns false if there was no room, in
+ * which case the path is left as it was.
+ *
+ * One byte is always kept back so that PATH_STOP can be added to a path
+ * that has run out of room.
+ */
+//***************************************************************************//
+
+/***
+ * Add a run of the given op, merging it into the last byte of the path
+ * where it fits.
+ */
+static bool add_run(uint8_t *path, uint8_t &length, uint8_t size, uint8_t op, uint8_t count) {
+  while (count > 0) {
+    uint8_t used = 0;
+    bool merge = length > 0 && path_op(path[length - 1]) == op;
+    if (merge) {
+      used = path_count(path[length - 1]);
+    }
+    if (not merge || used == PATH_MAX_COUNT) {
+      if (length + 1 >= size) {
+        return false;
+      }
+      path[length++] = op;
+      used = 0;
+    }
+    uint8_t added = min(count, (uint8_t)(PATH_MAX_COUNT - used));
+    path[length - 1] = op | (used + added);
+    count -= added;
+  }
+  return true;
+}
+
+/**
+ * Consecutive straights are merged into the same byte where they fit.
+ *
+ * @brief add some half cells of straight to the end of a path
+ */
+bool path_add_straight(uint8_t *path, uint8_t &length, uint8_t size, uint8_t half_cells) {
+  return add_run(path, length, size, PATH_STRAIGHT, half_cells);
+}
+
+/**
+ * @brief add some diagonal steps to the end of a path
+ */
+bool path_add_diagonal(uint8_t *path, uint8_t &length, uint8_t size, uint8_t steps) {
+  return add_run(path, length, size, PATH_DIAGONAL, steps);
+}
+
+/**
+ * @brief add a turn or the stop to the end of a path
+ */
+bool path_add_op(uint8_t *path, uint8_t &length, uint8_t size, uint8_t code) {
+  if (length + 1 >= size && code != PATH_STOP) {
+    return false;
+  }
+  if (length >= size) {
+    return false;
+  }
+  path[length++] = code;
+  return true;
+}
+
+/**
+ * The text uses the letters from Mouse::make_path(). 'B' and spaces are
+ * ignored so that hand-written paths can be easy to read. Each of 'R',
+ * 'L' and 'A' is a turn followed by a full cell forward. 'H' is half a
+ * cell forward.
+ *
+ * Returns false if the text has an unknown letter or does not fit. The
+ * path always ends with PATH_STOP.
+ *
+ * @brief convert path text into a byte code path
+ */
+bool path_from_text(const char *text, uint8_t *path, uint8_t size) {
+  uint8_t length = 0;
+  bool ok = true;
+  for (const char *p = text; ok && *p && *p != 'S'; p++) {
+    switch (*p) {
+      case 'F':
+        ok = path_add_straight(path, length, size, 2);
+        break;
+      case 'R':
+        ok = path_add_op(path, length, size, PATH_RIGHT) && path_add_straight(path, length, size, 2);
+        break;
+      case 'L':
+        ok = path_add_op(path, length, size, PATH_LEFT) && path_add_straight(path, length, size, 2);
+        break;
+      case 'A':
+        ok = path_add_op(path, length, size, PATH_AROUND) && path_add_straight(path, length, size, 2);
+        break;
+      case 'H':
+        ok = path_add_straight(path, length, size, 1);
+        break;
+      case 'B':
+      case ' ':
+        break;
+      default:
+        ok = false;
+        break;
+    }
+  }
+  path_add_op(path, length, size, PATH_STOP);
+  return ok;
+}
+
+/***
+ * Path text is either printed, when text is null, or written into the
+ * text buffer. Returns false if the buffer is full.
+ */
+static bool write_letter(char c, char *text, int size, int &length) {
+  if (text == nullptr) {
+    Serial.print(c);
+    return true;
+  }
+  if (length + 1 >= size) {
+    return false;
+  }
+  text[length++] = c;
+  return true;
+}
+
+/***
+ * Write a run of half cells as text. Each turn is written with the full
+ * cell that follows it so those two half cells are owed by the straight
+ * after it. A half cell left over is written as 'H'.
+ */
+static bool write_straight(uint8_t halves, uint8_t owed, char *text, int size, int &length) {
+  bool ok = true;
+  halves -= min(owed, halves);
+  for (uint8_t i = 0; i < halves / 2; i++) {
+    ok = ok && write_letter('F', text, size, length);
+  }
+  if (halves & 1) {
+    ok = ok && write_letter('H', text, size, length);
+  }
+  return ok;
+}
+
+static bool write_path_text(const uint8_t *path, char *text, int size, int &length) {
+  static const char turnLetters[] = "RLA";
+  uint8_t owed = 0;
+  uint8_t halves = 0; // a straight may be spread over several bytes
+  bool ok = write_letter('B', text, size, length);
+  for (const uint8_t *p = path; path_op(*p) != PATH_STOP; p++) {
+    uint8_t op = path_op(*p);
+    if (op == PATH_STRAIGHT) {
+      halves += path_count(*p);
+    } else {
+      ok = ok && write_straight(halves, owed, text, size, length);
+      ok = ok && write_letter(turnLetters[(op - PATH_RIGHT) >> 4], text, size, length);
+      halves = 0;
+      owed = 2;
+    }
+  }
+  ok = ok && write_straight(halves, owed, text, size, length);
+  return ok && write_letter('S', text, size, length);
+}
+
+/**
+ * Returns false if the text would not fit. The text is always terminated.
+ *
+ * @brief convert a byte code path into path text
+ */
+bool path_to_text(const uint8_t *path, char *text, int size) {
+  if (size <= 0) {
+    return false;
+  }
+  int length = 0;
+  bool ok = write_path_text(path, text, size, length);
+  text[length] = '\0';
+  return ok;
+}
+
+/**
+ * @brief print a byte code path as path text
+ */
+void print_path_text(const uint8_t *path) {
+  int length = 0;
+  write_path_text(path, nullptr, 0, length);
+  Serial.println();
+}
+
+//***************************************************************************//
+/*
+ * The diagonal path compiler.
+ *
+ * A path from make_path() is a list of 90 degree turns with straights
+ * between them. A zig-zag, where the turns alternate and are only a cell
+ * apart, can be run as a diagonal straight instead. The compiler looks at
+ * each turn, the gap after it and the turn that follows, and works along
+ * the path in one of two states:
+ *
+ * On a straight:
+ *  - a turn with another the opposite way a cell later starts a zig-zag
+ *    so it becomes an SD45.
+ *  - two turns the same way a cell apart become an SS180, or an SD135 if
+ *    a zig-zag starts straight after them.
+ *  - any other turn is a plain 90 degree turn.
+ *
+ * On a diagonal, at each corner of the zig-zag:
+ *  - if the next turn is the opposite way a cell later the diagonal
+ *    carries on for another step.
+ *  - two turns the same way a cell apart become a DD90 if the zig-zag
+ *    carries on after them, or a DS135 if it does not.
+ *  - otherwise the zig-zag ends here with a DS45.
+ *
+ * Straights in the compiled path are counted in half cells between the
+ * centres of the cells where the turns are, just as before compiling.
+ * Diagonals are counted in steps from one corner of the zig-zag to the
+ * next, each of which is the diagonal of a half cell.
+ */
+//***************************************************************************//
+
+/***
+ * A small window of the turns still to come in a path along with the
+ * half cells of straight before each of them. Turns that have run off the
+ * end of the path are PATH_STOP.
+ */
+struct TurnWindow {
+  const uint8_t *path;
+  uint8_t index;
+  uint8_t turn[3];
+  uint8_t halves[3];
+};
+
+static void read_turn(TurnWindow &w, uint8_t slot) {
+  uint8_t halves = 0;
+  while (path_op(w.path[w.index]) == PATH_STRAIGHT) {
+    halves += path_count(w.path[w.index]);
+    w.index++;
+  }
+  uint8_t op = path_op(w.path[w.index]);
+  if (op != PATH_STOP) {
+    w.index++;
+  }
+  w.turn[slot] = op;
+  w.halves[slot] = halves;
+}
+
+static void next_turn(TurnWindow &w) {
+  w.turn[0] = w.turn[1];
+  w.halves[0] = w.halves[1];
+  w.turn[1] = w.turn[2];
+  w.halves[1] = w.halves[2];
+  if (w.turn[1] == PATH_STOP) {
+    w.turn[2] = PATH_STOP;
+    w.halves[2] = 0;
+  } else {
+    read_turn(w, 2);
+  }
+}
+
+/**
+ * Only straights and 90 degree turns can be compiled. The compiled path
+ * is written to a separate array of the given size. Returns false if the
+ * path cannot be compiled or will not fit.
+ *
+ * @brief compile a path into one that runs zig-zags on the diagonal
+ */
+bool path_compile_diagonals(const uint8_t *path, uint8_t *compiled, uint8_t size) {
+  TurnWindow w;
+  w.path = path;
+  w.index = 0;
+  read_turn(w, 0);
+  w.turn[1] = PATH_STOP;
+  w.halves[1] = 0;
+  w.turn[2] = PATH_STOP;
+  w.halves[2] = 0;
+  if (w.turn[0] != PATH_STOP) {
+    read_turn(w, 1);
+    if (w.turn[1] != PATH_STOP) {
+      read_turn(w, 2);
+    }
+  }
+  uint8_t length = 0;
+  uint8_t steps = 0;
+  bool diagonal = false;
+  bool ok = true;
+  while (ok && w.turn[0] != PATH_STOP) {
+    uint8_t turn = w.turn[0];
+    if (turn != PATH_RIGHT && turn != PATH_LEFT) {
+      ok = false;
+      break;
+    }
+    uint8_t left = (turn == PATH_LEFT) ? PATH_TURN_LEFT : 0;
+    bool closeNext = w.turn[1] != PATH_STOP && w.halves[1] == 2;
+    bool sameNext = closeNext && w.turn[1] == turn;
+    bool zigzagAfter = sameNext && w.turn[2] != PATH_STOP && w.turn[2] != turn && w.halves[2] == 2;
+    if (not diagonal) {
+      ok = path_add_straight(compiled, length, size, w.halves[0]);
+      if (closeNext && not sameNext) {
+        ok = ok && path_add_op(compiled, length, size, PATH_SD45 | left);
+        diagonal = true;
+        steps = 1;
+        next_turn(w);
+      } else if (sameNext) {
+        ok = ok && path_add_op(compiled, length, size, (zigzagAfter ? PATH_SD135 : PATH_SS180) | left);
+        diagonal = zigzagAfter;
+        steps = 1;
+        next_turn(w);
+        next_turn(w);
+      } else {
+        ok = ok && path_add_op(compiled, length, size, turn);
+        next_turn(w);
+      }
+    } else {
+      if (closeNext && not sameNext) {
+        steps++;
+        next_turn(w);
+      } else {
+        ok = path_add_diagonal(compiled, length, size, steps);
+        if (sameNext) {
+          ok = ok && path_add_op(compiled, length, size, (zigzagAfter ? PATH_DD90 : PATH_DS135) | left);
+          diagonal = zigzagAfter;
+          steps = 1;
+          next_turn(w);
+          next_turn(w);
+        } else {
+          ok = ok && path_add_op(compiled, length, size, PATH_DS45 | left);
+          diagonal = false;
+          next_turn(w);
+        }
+      }
+    }
+  }
+  ok = ok && path_add_straight(compiled, length, size, w.halves[0]);
+  path_add_op(compiled, length, size, PATH_STOP);
+  return ok;
+}
+
+/**
+ * Every turn is entered and left at its own fixed forward speed in mm/s.
+ * Straights and diagonals have no speed of their own. The velocity planner
+ * works out how fast they can be run between the turns either side.
+ *
+ * Returns zero for anything that is not a smooth turn.
+ *
+ * @brief the forward speed of a turn
+ */
+uint16_t path_turn_speed(uint8_t code) {
+  switch (path_op(code)) {
+    case PATH_RIGHT:
+    case PATH_LEFT:
+    case PATH_SD45:
+    case PATH_DS45:
+      return SPEEDMAX_SMOOTH_TURN;
+    case PATH_SS180:
+    case PATH_SD135:
+    case PATH_DS135:
+    case PATH_DD90:
+      return SPEEDMAX_TIGHT_TURN;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Straights are F and diagonals are D, followed by the number of half
+ * cells or steps. Turns are printed by name.
+ *
+ * @brief print a single path code with a short name and its count
+ */
+void print_path_code(uint8_t code) {
+  uint8_t op = path_op(code);
+  switch (op) {
+    case PATH_STRAIGHT:
+      Serial.print('F');
+      Serial.print(path_count(code));
+      break;
+    case PATH_DIAGONAL:
+      Serial.print('D');
+      Serial.print(path_count(code));
+      break;
+    case PATH_RIGHT:
+      Serial.print(F("SS90R"));
+      break;
+    case PATH_LEFT:
+      Serial.print(F("SS90L"));
+      break;
+    case PATH_AROUND:
+      Serial.print('A');
+      break;
+    default:
+      static const char turnNames[] = "SS180SD45 SD135DS45 DS135DD90 ";
+      for (uint8_t i = 0; i < 5; i++) {
+        char c = turnNames[((op - PATH_SS180) >> 4) * 5 + i];
+        if (c != ' ') {
+          Serial.print(c);
+        }
+      }
+      Serial.print((code & PATH_TURN_LEFT) ? 'L' : 'R');
+      break;
+  }
+}
+
+/**
+ * @brief print a compiled path
+ */
+void print_path_codes(const uint8_t *path) {
+  for (const uint8_t *p = path; path_op(*p) != PATH_STOP; p++) {
+    print_path_code(*p);
+    Serial.print(' ');
+  }
+  Serial.println('S');
+}
@@ -0,0 +1,96 @@
+/*
+ * File: path.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:18:13 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:21:26 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdint.h>
+
+/***
+ * Speed run paths are stored as byte codes rather than text. The high
+ * nibble of each byte is the operation and the low nibble is a count.
+ *
+ * A path starts in the middle of a cell. Turns happen in the middle of a
+ * cell so they are always between straights of at least one half cell.
+ * Long straights need more than one byte.
+ *
+ * The path text used for printing and comparing paths has one letter for
+ * each cell, as described for Mouse::make_path(). The functions here
+ * convert between the two.
+ *
+ * A path can also be compiled into one that cuts across zig-zags on the
+ * diagonal. The turns in a compiled path are named for the kind of line
+ * they join, S for straight and D for diagonal, and for the angle. So an
+ * SD45 turns through 45 degrees from a straight onto a diagonal. For these
+ * turns the count is PATH_TURN_LEFT or zero for a right turn. A 90 degree
+ * turn between straights is still PATH_RIGHT or PATH_LEFT.
+ */
+enum PathOp : uint8_t {
+  PATH_STOP = 0x00,     // the end of the path
+  PATH_STRAIGHT = 0x10, // forward by count half cells
+  PATH_RIGHT = 0x20,    // turn right through 90 degrees
+  PATH_LEFT = 0x30,     // turn left through 90 degrees
+  PATH_AROUND = 0x40,   // turn around. Should never be in a speed run
+  PATH_SS180 = 0x50,    // straight to straight through 180 degrees
+  PATH_SD45 = 0x60,     // straight to diagonal through 45 degrees
+  PATH_SD135 = 0x70,    // straight to diagonal through 135 degrees
+  PATH_DS45 = 0x80,     // diagonal to straight through 45 degrees
+  PATH_DS135 = 0x90,    // diagonal to straight through 135 degrees
+  PATH_DD90 = 0xA0,     // diagonal to diagonal through 90 degrees
+  PATH_DIAGONAL = 0xB0, // forward by count diagonal steps, corner to corner
+};
+
+#define PATH_OP_MASK 0xF0
+#define PATH_COUNT_MASK 0x0F
+#define PATH_MAX_COUNT 15
+#define PATH_TURN_LEFT 0x01
+
+inline uint8_t path_op(uint8_t code) {
+  return code & PATH_OP_MASK;
+}
+
+inline uint8_t path_count(uint8_t code) {
+  return code & PATH_COUNT_MASK;
+}
+
+bool path_add_straight(uint8_t *path, uint8_t &length, uint8_t size, uint8_t half_cells);
+bool path_add_diagonal(uint8_t *path, uint8_t &length, uint8_t size, uint8_t steps);
+bool path_add_op(uint8_t *path, uint8_t &length, uint8_t size, uint8_t code);
+bool path_from_text(const char *text, uint8_t *path, uint8_t size);
+bool path_to_text(const uint8_t *path, char *text, int size);
+void print_path_text(const uint8_t *path);
+bool path_compile_diagonals(const uint8_t *path, uint8_t *compiled, uint8_t size);
+uint16_t path_turn_speed(uint8_t code);
+void print_path_code(uint8_t code);
+void print_path_codes(const uint8_t *path);
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ * File: planner.cpp
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:16:00 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:29:33 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "planner.h"
+#include "config.h"
+#include "motion.h"
+#include "mouse.h"
+#include "path.h"
+#include <Arduino.h>
+
+//***************************************************************************//
+/*
+ * This is a look-ahead velocity planner of the kind used in CNC machine
+ * firmware.
+ *
+ * Segments are added at one end of a small ring buffer and taken from the
+ * other as they are run. Every time a segment is added, the entry speeds of
+ * all the segments in the buffer are worked out again in two passes:
+ *
+ *  - a backward pass, from the newest segment to the oldest, makes sure that
+ *    each segment is entered slowly enough to get down to the entry speed of
+ *    the one after it. Nothing is known beyond the newest segment so it is
+ *    assumed that the robot must be able to stop at the end of it.
+ *
+ *  - a forward pass, from the oldest segment to the newest, makes sure that
+ *    no segment expects to be entered faster than the robot can accelerate
+ *    to over the segment before it.
+ *
+ * Turns are run at a fixed forward speed so they are entered and left at
+ * that speed, or slower if the segments around them insist. A spin turn has
+ * a speed of zero so the robot stops for it.
+ *
+ * The entry speed of the oldest segment is the exit speed of the segment
+ * that was last taken so it never changes.
+ *
+ * The backward pass is pessimistic about the newest segment but, with turns
+ * that are never faster than about 500 mm/s, it only takes one short
+ * straight to stop from turn speed. With PLANNER_SIZE segments of
+ * look-ahead, the segment being taken is never affected.
+ */
+//***************************************************************************//
+
+static Segment s_segments[PLANNER_SIZE];
+static uint8_t s_oldest = 0;
+static uint8_t s_count = 0;
+static float s_top_speed = 0;
+static float s_acceleration = 1;
+static float s_exit_speed = 0; // of the segment last taken
+
+static bool is_straight(const Segment &segment) {
+  return segment.type == SEGMENT_STRAIGHT || segment.type == SEGMENT_DIAGONAL;
+}
+
+static Segment &segment_at(uint8_t index) {
+  return s_segments[(s_oldest + index) & (PLANNER_SIZE - 1)];
+}
+
+/***
+ * The fastest that a segment can be entered and still get down to the
+ * given speed by the end of it.
+ */
+static float max_entry_for_exit(const Segment &segment, float exit_speed) {
+  if (not is_straight(segment)) {
+    return exit_speed;
+  }
+  return sqrtf(exit_speed * exit_speed + 2.0f * s_acceleration * segment.length);
+}
+
+/***
+ * The fastest that a segment can be left when it is entered at the given
+ * speed.
+ */
+static float max_exit_for_entry(const Segment &segment, float entry_speed) {
+  if (not is_straight(segment)) {
+    return entry_speed;
+  }
+  return sqrtf(entry_speed * entry_speed + 2.0f * s_acceleration * segment.length);
+}
+
+static void plan_segments() {
+  float exitSpeed = 0;
+  for (uint8_t i = s_count - 1; i > 0; i--) {
+    Segment &segment = segment_at(i);
+    float entry = max_entry_for_exit(segment, exitSpeed);
+    if (entry > segment.max_entry) {
+      entry = segment.max_entry;
+    }
+    segment.entry = (uint16_t)entry;
+    exitSpeed = entry;
+  }
+  for (uint8_t i = 0; i + 1 < s_count; i++) {
+    Segment &segment = segment_at(i);
+    Segment &next = segment_at(i + 1);
+    float reachable = max_exit_for_entry(segment, segment.entry);
+    if (next.entry > reachable) {
+      next.entry = (uint16_t)reachable;
+    }
+  }
+}
+
+/**
+ * Empties the planner ready for a new run that starts from rest.
+ *
+ * @brief start planning a new run
+ */
+void planner_init(float top_speed, float acceleration) {
+  s_oldest = 0;
+  s_count = 0;
+  s_top_speed = top_speed;
+  s_acceleration = acceleration;
+  s_exit_speed = 0;
+}
+
+bool planner_is_full() {
+  return s_count == PLANNER_SIZE;
+}
+
+bool planner_is_empty() {
+  return s_count == 0;
+}
+
+/**
+ * Add a segment to the end of the plan and work out the speeds again.
+ *
+ * For a straight, length is in mm and straights are run as fast as the
+ * planner allows. A non-zero speed limits them to less than the top speed
+ * of the run. For a turn, length is ignored and speed is the forward speed
+ * that the turn is run at. A SEGMENT_TURN also needs the path code for the
+ * kind of turn so that it can be passed on when the turn is run.
+ *
+ * There is no check for overflow. Use planner_is_full() first.
+ *
+ * @brief add a straight or turn to the plan
+ */
+void planner_add(SegmentType type, float length, float speed, uint8_t turn) {
+  Segment &segment = segment_at(s_count);
+  segment.type = type;
+  segment.turn = turn;
+  if (is_straight(segment)) {
+    segment.length = (uint16_t)length;
+    segment.max_entry = (uint16_t)((speed > 0 && speed < s_top_speed) ? speed : s_top_speed);
+  } else {
+    segment.length = 0;
+    segment.max_entry = (uint16_t)speed;
+  }
+  if (s_count == 0) {
+    segment.entry = (uint16_t)min(s_exit_speed, (float)segment.max_entry);
+  } else {
+    segment.entry = segment.max_entry;
+  }
+  s_count++;
+  plan_segments();
+}
+
+/**
+ * Remove the oldest segment from the plan along with the speeds needed to
+ * run it. A straight accelerates from its entry speed towards top_speed
+ * and must be at exit_speed by the end. The top speed is only as high as
+ * the robot can actually reach in the length available.
+ *
+ * Returns false if there is nothing left to run.
+ *
+ * @brief take the next segment to run
+ */
+bool planner_take(PlannedSegment &planned) {
+  if (s_count == 0) {
+    return false;
+  }
+  Segment &segment = segment_at(0);
+  float entry = segment.entry;
+  float exit = (s_count > 1) ? segment_at(1).entry : 0;
+  float top = entry;
+  if (is_straight(segment)) {
+    // the peak of a triangular profile from entry to exit
+    top = sqrtf(s_acceleration * segment.length + 0.5f * (entry * entry + exit * exit));
+    if (top > segment.max_entry) {
+      top = segment.max_entry;
+    }
+  } else {
+    exit = entry;
+  }
+  planned.turn_scale = 1;
+  if (segment.type == SEGMENT_TURN && entry < segment.max_entry) {
+    planned.turn_scale = entry / segment.max_entry;
+  }
+  planned.type = segment.type;
+  planned.turn = segment.turn;
+  planned.length = segment.length;
+  planned.entry_speed = entry;
+  planned.top_speed = max(top, max(entry, exit));
+  planned.exit_speed = exit;
+  s_exit_speed = exit;
+  s_oldest = (s_oldest + 1) & (PLANNER_SIZE - 1);
+  s_count--;
+  return true;
+}
+
+//***************************************************************************//
+
+static SegmentHandler s_handler;
+static bool s_handler_ok;
+
+/***
+ * Pass a planned segment to the handler. A smooth turn needs some forward
+ * speed. If the planner could not give it any, perhaps because it comes
+ * straight after the start, the path cannot be run.
+ */
+static bool hand_over(const PlannedSegment &planned) {
+  if (planned.type == SEGMENT_TURN && planned.entry_speed < 1) {
+    return false;
+  }
+  return s_handler(planned);
+}
+
+/***
+ * Add a segment to the plan. When the planner is full, the oldest segment
+ * is handed over first to make room.
+ */
+static void plan_segment(SegmentType type, float length, float speed, uint8_t turn = 0) {
+  PlannedSegment planned;
+  if (planner_is_full() && planner_take(planned)) {
+    s_handler_ok = s_handler_ok && hand_over(planned);
+  }
+  planner_add(type, length, speed, turn);
+}
+
+/***
+ * Add the straight between two turns. The turns take their run-in and
+ * run-out from it so a negative length means that they overlap. That path
+ * cannot be run so the plan is abandoned.
+ */
+static void plan_straight(SegmentType line, float length) {
+  if (length < 0) {
+    s_handler_ok = false;
+  } else if (length > 0 && s_handler_ok) {
+    plan_segment(line, length, line == SEGMENT_DIAGONAL ? SPEEDMAX_DIAGONAL : 0);
+  }
+}
+
+/**
+ * The straights in the path are in half cells and turns happen in the
+ * middle of a cell. A path compiled for diagonals also has diagonal steps,
+ * which run from one corner of a zig-zag to the next.
+ *
+ * Turns are either in-place spin turns or smooth turns. Each kind of
+ * smooth turn takes its own run-in and run-out from the lines either side
+ * of it, as given by get_turn_parameters(). Spin turns can only be used
+ * with a path that has not been compiled for diagonals.
+ *
+ * Every straight and turn goes through the planner and each planned
+ * segment is passed to the handler in order. The handler can return false
+ * to abandon the rest of the path and then so does this function. It also
+ * returns false, having handed over only part of the path, if two turns
+ * are so close together that their run-in and run-out overlap or if a
+ * smooth turn would have to be entered from rest.
+ *
+ * There is only one planner so nothing else can be planned until this
+ * returns.
+ *
+ * @brief plan a whole path, handing over the segments as they are planned
+ */
+bool plan_path(const uint8_t *path, bool smooth_turns, float top_speed, float acceleration, SegmentHandler handler) {
+  s_handler = handler;
+  s_handler_ok = true;
+  planner_init(top_speed, acceleration);
+  float straight = 0;
+  SegmentType line = SEGMENT_STRAIGHT;
+  for (int index = 0; s_handler_ok && path_op(path[index]) != PATH_STOP; index++) {
+    uint8_t op = path_op(path[index]);
+    TurnParameters turn;
+    if (op == PATH_STRAIGHT) {
+      straight += path_count(path[index]) * HALF_CELL;
+    } else if (op == PATH_DIAGONAL) {
+      straight += path_count(path[index]) * DIAGONAL_STEP;
+    } else if (not smooth_turns && (op == PATH_RIGHT || op == PATH_LEFT)) {
+      plan_straight(SEGMENT_STRAIGHT, straight);
+      plan_segment(op == PATH_RIGHT ? SEGMENT_SPIN_RIGHT : SEGMENT_SPIN_LEFT, 0, 0);
+      straight = 0;
+    } else if (smooth_turns && get_turn_parameters(path[index], turn)) {
+      straight += turn.run_in;
+      plan_straight(line, straight);
+      if (not s_handler_ok) {
+        break;
+      }
+      plan_segment(SEGMENT_TURN, 0, path_turn_speed(path[index]), path[index]);
+      straight = turn.run_out;
+      // the turns that leave on a diagonal are SD45, SD135 and DD90
+      line = (op == PATH_SD45 || op == PATH_SD135 || op == PATH_DD90) ? SEGMENT_DIAGONAL : SEGMENT_STRAIGHT;
+    } else {
+      // debug << F("Instruction error!\n");
+      break;
+    }
+  }
+  plan_straight(line, straight);
+  PlannedSegment planned;
+  while (s_handler_ok && planner_take(planned)) {
+    s_handler_ok = hand_over(planned);
+  }
+  return s_handler_ok;
+}
@@ -0,0 +1,89 @@
+/*
+ * File: planner.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:16:00 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:29:33 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stdint.h>
+
+/***
+ * A speed run is a sequence of straights and turns. The planner holds the
+ * next few of them and works out how fast each one should be entered so
+ * that the robot never has to stop between them.
+ */
+enum SegmentType : uint8_t {
+  SEGMENT_STRAIGHT,
+  SEGMENT_DIAGONAL, // a straight run on the diagonal
+  SEGMENT_TURN,     // a smooth turn. The kind is given by its path code
+  SEGMENT_SPIN_LEFT,
+  SEGMENT_SPIN_RIGHT,
+};
+
+struct Segment {
+  SegmentType type;
+  uint8_t turn;       // the path code of a SEGMENT_TURN
+  uint16_t length;    // mm of forward travel. Turns have no length
+  uint16_t max_entry; // mm/s. The fastest the segment may be entered
+  uint16_t entry;     // mm/s. The planned entry speed
+};
+
+/***
+ * A planned segment as it is handed over to be run. Turns are run at
+ * their entry speed and leave at the same speed.
+ *
+ * The planner may have to enter a smooth turn slower than the speed it was
+ * designed for. To keep the same shape, the turn rate and the angular
+ * acceleration must then be scaled down by turn_scale and turn_scale
+ * squared. It is 1 for everything else.
+ */
+struct PlannedSegment {
+  SegmentType type;
+  uint8_t turn;
+  float length;
+  float entry_speed;
+  float top_speed;
+  float exit_speed;
+  float turn_scale;
+};
+
+#define PLANNER_SIZE 16 // segments of look-ahead. Must be a power of two
+
+void planner_init(float top_speed, float acceleration);
+bool planner_is_full();
+bool planner_is_empty();
+void planner_add(SegmentType type, float length, float speed, uint8_t turn = 0);
+bool planner_take(PlannedSegment &segment);
+
+typedef bool (*SegmentHandler)(const PlannedSegment &segment);
+bool plan_path(const uint8_t *path, bool smooth_turns, float top_speed, float acceleration, SegmentHandler handler);
+
+#endif
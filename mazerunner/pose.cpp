@@ -0,0 +1,206 @@
+/*
+ * File: pose.cpp
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:54:09 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:57:16 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pose.h"
+#include "config.h"
+#include "encoders.h"
+#include "maze.h"
+#include <Arduino.h>
+#include <util/atomic.h>
+
+/***
+ * sin() takes well over 100us on the ATmega328p. This table has one entry
+ * per degree for the first quadrant, scaled by 32767. With linear
+ * interpolation between entries it is good to better than 1e-4.
+ */
+static const uint16_t SINE_TABLE[91] PROGMEM = {
+    0, 572, 1144, 1715, 2286, 2856, 3425, 3993, 4560, 5126,
+    5690, 6252, 6813, 7371, 7927, 8481, 9032, 9580, 10126, 10668,
+    11207, 11743, 12275, 12803, 13328, 13848, 14364, 14876, 15383, 15886,
+    16383, 16876, 17364, 17846, 18323, 18794, 19260, 19720, 20173, 20621,
+    21062, 21497, 21925, 22347, 22762, 23170, 23571, 23964, 24351, 24730,
+    25101, 25465, 25821, 26169, 26509, 26841, 27165, 27481, 27788, 28087,
+    28377, 28659, 28932, 29196, 29451, 29697, 29934, 30162, 30381, 30591,
+    30791, 30982, 31163, 31335, 31498, 31650, 31794, 31927, 32051, 32165,
+    32269, 32364, 32448, 32523, 32587, 32642, 32687, 32722, 32747, 32762,
+    32767,
+};
+
+float sin_deg(float angle) {
+  float whole = floorf(angle);
+  float fraction = angle - whole;
+  int16_t index = (int32_t)whole % 360;
+  if (index < 0) {
+    index += 360;
+  }
+  bool negative = index >= 180;
+  if (negative) {
+    index -= 180;
+  }
+  int16_t a;
+  int16_t b;
+  if (index < 90) {
+    a = pgm_read_word(&SINE_TABLE[index]);
+    b = pgm_read_word(&SINE_TABLE[index + 1]);
+  } else {
+    a = pgm_read_word(&SINE_TABLE[180 - index]);
+    b = pgm_read_word(&SINE_TABLE[179 - index]);
+  }
+  float result = (a + fraction * (b - a)) * (1.0f / 32767);
+  return negative ? -result : result;
+}
+
+float cos_deg(float angle) {
+  return sin_deg(angle + 90);
+}
+
+static volatile Pose s_pose;
+
+static float wrap_angle(float angle) {
+  while (angle >= 180) {
+    angle -= 360;
+  }
+  while (angle < -180) {
+    angle += 360;
+  }
+  return angle;
+}
+
+static float heading_angle(uint8_t heading) {
+  return 90 - 90 * (heading & 0x03);
+}
+
+/***
+ * @brief return the maze heading, NORTH to WEST, that is closest to theta
+ */
+uint8_t nearest_heading(float theta) {
+  return (int)floorf((135 - theta) / 90) & 0x03;
+}
+
+/***
+ * Called from systick just after the encoders are updated. The forward
+ * increment is taken to be along the mean of the old and new headings,
+ * which is as good as an arc over a single tick.
+ *
+ * The pose has its own heading so it is not upset when reset_encoders()
+ * clears the robot angle.
+ */
+void update_pose() {
+  float distance = (float)robot_fwd_increment();
+  float rotation = (float)robot_rot_increment();
+  float direction = s_pose.theta + 0.5f * rotation;
+  s_pose.x += distance * cos_deg(direction);
+  s_pose.y += distance * sin_deg(direction);
+  s_pose.theta = wrap_angle(s_pose.theta + rotation);
+}
+
+Pose robot_pose() {
+  Pose pose;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    pose.x = s_pose.x;
+    pose.y = s_pose.y;
+    pose.theta = s_pose.theta;
+  }
+  return pose;
+}
+
+void set_pose(float x, float y, float theta) {
+  theta = wrap_angle(theta);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    s_pose.x = x;
+    s_pose.y = y;
+    s_pose.theta = theta;
+  }
+}
+
+/***
+ * @brief put the robot on the centre line of a cell, forward mm past the centre
+ */
+void set_pose_in_cell(uint8_t cell, uint8_t heading, float forward) {
+  float theta = heading_angle(heading);
+  float x = ((cell / MAZE_WIDTH) + 0.5f) * FULL_CELL + forward * cos_deg(theta);
+  float y = ((cell % MAZE_WIDTH) + 0.5f) * FULL_CELL + forward * sin_deg(theta);
+  set_pose(x, y, theta);
+}
+
+/***
+ * Cells are numbered up the columns so north is +1 and east is +MAZE_WIDTH.
+ * A robot outside the maze is counted as being in the nearest cell.
+ */
+CellOffset robot_cell_offset(uint8_t heading) {
+  Pose pose = robot_pose();
+  int column = constrain((int)floorf(pose.x / FULL_CELL), 0, MAZE_WIDTH - 1);
+  int row = constrain((int)floorf(pose.y / FULL_CELL), 0, MAZE_WIDTH - 1);
+  float dx = pose.x - (column + 0.5f) * FULL_CELL;
+  float dy = pose.y - (row + 0.5f) * FULL_CELL;
+  CellOffset offset;
+  offset.cell = column * MAZE_WIDTH + row;
+  offset.angle = wrap_angle(pose.theta - heading_angle(heading));
+  switch (heading & 0x03) {
+    case NORTH:
+      offset.forward = dy;
+      offset.lateral = -dx;
+      break;
+    case EAST:
+      offset.forward = dx;
+      offset.lateral = dy;
+      break;
+    case SOUTH:
+      offset.forward = -dy;
+      offset.lateral = dx;
+      break;
+    default: // WEST
+      offset.forward = -dx;
+      offset.lateral = -dy;
+      break;
+  }
+  return offset;
+}
+
+/***
+ * Something, like a wall edge, has shown how far the robot really is past
+ * the centre of its cell. Only the component along the heading is changed
+ * and systick can carry on updating the pose while the change is worked
+ * out.
+ *
+ * @brief correct the pose along the heading without stopping
+ */
+void adjust_pose_forward(uint8_t heading, float forward) {
+  float error = forward - robot_cell_offset(heading).forward;
+  float theta = heading_angle(heading);
+  float dx = error * cos_deg(theta);
+  float dy = error * sin_deg(theta);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    s_pose.x += dx;
+    s_pose.y += dy;
+  }
+}
@@ -0,0 +1,75 @@
+/*
+ * File: pose.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:54:09 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:57:16 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef POSE_H
+#define POSE_H
+
+#include <stdint.h>
+
+/***
+ * The pose is where the robot is in the maze. x is east and y is north, in
+ * mm from the outside corner of the start cell, and theta is in degrees
+ * anticlockwise from east so that a robot heading NORTH has a theta of 90.
+ *
+ * It is worked out in systick from the same encoder increments that the
+ * motor controllers use. It knows nothing about walls so it will drift
+ * unless the search or speed run code corrects it.
+ */
+struct Pose {
+  float x;
+  float y;
+  float theta; // -180 to 180
+};
+
+/***
+ * Where the robot is relative to the centre of the cell it is in, seen
+ * from a robot that faces the given heading.
+ */
+struct CellOffset {
+  uint8_t cell;
+  float forward; // mm ahead of the cell centre
+  float lateral; // mm to the left of the cell centre
+  float angle;   // deg to the left of the heading
+};
+
+float sin_deg(float angle);
+float cos_deg(float angle);
+uint8_t nearest_heading(float theta);
+
+void update_pose();
+Pose robot_pose();
+void set_pose(float x, float y, float theta);
+void set_pose_in_cell(uint8_t cell, uint8_t heading, float forward);
+CellOffset robot_cell_offset(uint8_t heading);
+void adjust_pose_forward(uint8_t heading, float forward);
+
+#endif
@@ -34,14 +34,20 @@
 #define PROFILE_H
 
 #include "encoders.h"
+#include "fixed.h"
 #include "settings.h"
 #include <Arduino.h>
 #include <util/atomic.h>
 //***************************************************************************//
-class Profile;
+template <typename T>
+class BasicProfile;
 
-extern Profile forward;
-extern Profile rotation;
+/***
+ * A Profile does its sums in systick with a control_t so it is a float or
+ * a fixed point profile depending on USE_FIXED_POINT_CONTROL in config.h.
+ * Everything outside systick still sees floats.
+ */
+typedef BasicProfile<control_t> Profile;
 
 enum ProfileState : uint8_t {
   CS_IDLE = 0,
@@ -50,7 +56,8 @@ enum ProfileState : uint8_t {
   CS_FINISHED = 3,
 };
 
-class Profile {
+template <typename T>
+class BasicProfile {
   public:
   void reset() {
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
@@ -88,11 +95,13 @@ class Profile {
     m_target_speed = m_sign * fabsf(top_speed);
     m_final_speed = m_sign * fabsf(final_speed);
     m_acceleration = fabsf(acceleration);
-    if (m_acceleration >= 1) {
-      m_one_over_acc = 1.0f / m_acceleration;
+    m_delta_v = per_tick(m_acceleration);
+    if (fabsf(acceleration) >= 1) {
+      m_one_over_acc = 1.0f / fabsf(acceleration);
     } else {
       m_one_over_acc = 1.0;
     }
+    m_brake_position = get_brake_position(distance, fabsf((float)m_speed), fabsf(top_speed), fabsf(final_speed), m_one_over_acc);
     m_state = CS_ACCELERATING;
   }
 
@@ -112,14 +121,48 @@ class Profile {
 
   void set_state(ProfileState state) { m_state = state; }
 
+  // worked out as a float because the squared speeds will not fit in a Fixed
   float get_braking_distance() {
-    return fabsf(m_speed * m_speed - m_final_speed * m_final_speed) * 0.5 * m_one_over_acc;
+    float speed = (float)m_speed;
+    float final_speed = (float)m_final_speed;
+    return fabsf(speed * speed - final_speed * final_speed) * 0.5 * m_one_over_acc;
+  }
+
+  /***
+   * While it is accelerating, the speed of a profile only depends on how far
+   * it has gone so the point where the remaining distance becomes less than
+   * the braking distance can be worked out once, when it starts. Then
+   * update() only has to compare positions. The speed changes in steps so
+   * braking may start up to a tick away from where get_braking_distance()
+   * would have started it.
+   *
+   * If the speed is already below the final speed, and there is not room
+   * to get up to it, braking starts at once. The same goes for a speed that
+   * is above the top speed and has no room to get down to the final speed.
+   */
+  static float get_brake_position(float distance, float speed, float top_speed, float final_speed, float one_over_acc) {
+    float brake = distance - (top_speed * top_speed - final_speed * final_speed) * 0.5f * one_over_acc;
+    float room = (speed * speed - final_speed * final_speed) * 0.5f * one_over_acc;
+    if (speed <= top_speed) {
+      // the peak of a triangular profile is only beyond the top speed
+      // cruising point if the top speed is never reached
+      float peak = 0.5f * (distance - room);
+      if (peak > brake) {
+        brake = peak;
+      }
+      if (distance < -room) {
+        brake = 0;
+      }
+    } else if (distance < room) {
+      brake = 0;
+    }
+    return max(brake, 0.0f);
   }
 
   float position() {
     float pos;
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-      pos = m_position;
+      pos = (float)m_position;
     }
     return pos;
   }
@@ -127,15 +170,16 @@ class Profile {
   float speed() {
     float speed;
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-      speed = m_speed;
+      speed = (float)m_speed;
     }
     return speed;
   }
 
-  float increment() {
-    float inc;
+  // used by the motor controllers in systick so it stays as a T
+  T increment() {
+    T inc;
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-      inc = m_speed * LOOP_INTERVAL;
+      inc = per_tick(m_speed);
     }
     return inc;
   }
@@ -143,7 +187,7 @@ class Profile {
   float acceleration() {
     float acc;
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-      acc = m_acceleration;
+      acc = (float)m_acceleration;
     }
     return acc;
   }
@@ -162,10 +206,39 @@ class Profile {
   // normally only used to alter position for forward error correction
   void adjust_position(float adjustment) {
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { m_position += adjustment; }
+    update_brake_position();
   }
 
   void set_position(float position) {
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { m_position = position; }
+    update_brake_position();
+  }
+
+  /***
+   * The brake position from start() assumes that the speed only depends on
+   * how far the profile has gone. Once the position has been changed from
+   * outside, that is no longer true so it is worked out again from the
+   * current position and speed. The sums are done with interrupts enabled
+   * so systick may move the profile on by a tick before the new brake
+   * position is stored.
+   */
+  void update_brake_position() {
+    uint8_t state;
+    float position;
+    float speed;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      state = m_state;
+      position = fabsf((float)m_position);
+      speed = fabsf((float)m_speed);
+    }
+    if (state != CS_ACCELERATING) {
+      return;
+    }
+    float distance = fabsf((float)m_final_position) - position;
+    float top_speed = fabsf((float)m_target_speed);
+    float final_speed = fabsf((float)m_final_speed);
+    float brake = position + get_brake_position(distance, speed, top_speed, final_speed, m_one_over_acc);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { m_brake_position = brake; }
   }
 
   // update is called from within systick and shoul dbe safe from interrupts
@@ -173,13 +246,12 @@ class Profile {
     if (m_state == CS_IDLE) {
       return;
     }
-    float delta_v = m_acceleration * LOOP_INTERVAL;
-    float remaining = fabsf(m_final_position) - fabsf(m_position);
+    T remaining = fabsf(m_final_position) - fabsf(m_position);
     if (m_state == CS_ACCELERATING) {
-      if (remaining < get_braking_distance()) {
+      if (fabsf(m_position) >= m_brake_position) {
         m_state = CS_BRAKING;
         if (m_final_speed == 0) {
-          m_target_speed = m_sign * 5.0f;
+          m_target_speed = m_sign * T(5.0f);
         } else {
           m_target_speed = m_final_speed;
         };
@@ -187,35 +259,55 @@ class Profile {
     }
     // try to reach the target speed
     if (m_speed < m_target_speed) {
-      m_speed += delta_v;
+      m_speed += m_delta_v;
       if (m_speed > m_target_speed) {
         m_speed = m_target_speed;
       }
     }
     if (m_speed > m_target_speed) {
-      m_speed -= delta_v;
+      m_speed -= m_delta_v;
       if (m_speed < m_target_speed) {
         m_speed = m_target_speed;
       }
     }
     // increment the position
-    m_position += m_speed * LOOP_INTERVAL;
-    if (m_state != CS_FINISHED && remaining < 0.125) {
+    m_position += per_tick(m_speed);
+    if (m_state != CS_FINISHED && remaining < T(0.125f)) {
       m_state = CS_FINISHED;
       m_target_speed = m_final_speed;
     }
   }
 
-  private:
+  protected:
+  // systick changes the speed and position so they are only read or
+  // written outside systick in an ATOMIC_BLOCK
   volatile uint8_t m_state = CS_IDLE;
-  volatile float m_speed = 0;
-  volatile float m_position = 0;
+  T m_speed = 0;
+  T m_position = 0;
   int8_t m_sign = 1;
-  float m_acceleration = 0;
+  T m_acceleration = 0;
+  T m_delta_v = 0;
   float m_one_over_acc = 1;
-  float m_target_speed = 0;
-  float m_final_speed = 0;
-  float m_final_position = 0;
+  T m_target_speed = 0;
+  T m_final_speed = 0;
+  T m_final_position = 0;
+  T m_brake_position = 0;
 };
 
+/***
+ * The forward and rotation profiles are either plain trapezoidal profiles
+ * or S-curve profiles depending on USE_SCURVE_PROFILES in config.h. The
+ * choice is made here at compile time, in the same way as control_t, so
+ * that systick calls update() directly rather than through a vtable.
+ */
+#if USE_SCURVE_PROFILES
+#include "scurve.h"
+typedef SCurveProfile MotionProfile;
+#else
+typedef Profile MotionProfile;
+#endif
+
+extern MotionProfile forward;
+extern MotionProfile rotation;
+
 #endif
\ No newline at end of file
@@ -26,60 +26,89 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
+#include <stdint.h>
+
+/**
+ * Pick the smallest unsigned type that can index a queue of N items.
+ * Eight bit indices are much cheaper on the AVR.
+ */
+template <uint32_t N, bool is_small = (N <= 256)>
+struct QueueIndex {
+  typedef uint8_t type;
+};
+
+template <uint32_t N>
+struct QueueIndex<N, false> {
+  typedef uint16_t type;
+};
+
 /**
  * The Queue class is used to speed up flooding of the maze
+ *
+ * Storage is a fixed array inside the object so there is no use of the
+ * heap. The size, N, must be a power of two so that the head and tail can
+ * wrap with a simple mask. One slot is always left empty to tell a full
+ * queue from an empty one so the queue holds at most N-1 items.
+ *
+ * Adding to a full queue does nothing and returns false so an item can
+ * be lost but the queue is never corrupted. Users should still be sure
+ * that the queue is big enough for the job.
  */
-template <class item_t>
+template <class item_t, uint32_t N>
 class Queue {
+  static_assert(N >= 2, "Queue must have at least two slots");
+  static_assert((N & (N - 1)) == 0, "Queue size must be a power of two");
+  static_assert(N <= 65536, "Queue is too big for 16 bit indices");
+  typedef typename QueueIndex<N>::type index_t;
+
   public:
-  explicit Queue(int maxSize = 64) : MAX_ITEMS(maxSize) {
-    mData = new item_t[MAX_ITEMS + 1];
+  static const uint32_t CAPACITY = N - 1;
+
+  Queue() {
     clear();
   }
 
-  ~Queue() {
-    delete[] mData;
-  };
+  index_t size() const {
+    return (mTail - mHead) & MASK;
+  }
+
+  bool empty() const {
+    return mHead == mTail;
+  }
 
-  int size() {
-    return mItemCount;
+  bool full() const {
+    return size() == CAPACITY;
   }
 
   void clear() {
     mHead = 0;
     mTail = 0;
-    mItemCount = 0;
   }
 
-  void add(item_t item) {
-    mData[mTail] = item;
-    ++mTail;
-    ++mItemCount;
-    if (mTail > MAX_ITEMS) {
-      mTail -= MAX_ITEMS;
+  bool add(item_t item) {
+    if (full()) {
+      return false;
     }
+    mData[mTail] = item;
+    mTail = (mTail + 1) & MASK;
+    return true;
   }
 
   item_t head() {
     item_t result = mData[mHead];
-    ++mHead;
-    if (mHead > MAX_ITEMS) {
-      mHead -= MAX_ITEMS;
-    }
-    --mItemCount;
+    mHead = (mHead + 1) & MASK;
     return result;
   }
 
   protected:
-  item_t *mData;
-  const int MAX_ITEMS;
-  int mHead;
-  int mTail;
-  int mItemCount;
+  static const index_t MASK = N - 1;
+  item_t mData[N];
+  index_t mHead;
+  index_t mTail;
 
   private:
   // while this is probably correct, prevent use of the copy constructor
-  Queue(const Queue<item_t> &rhs) {}
+  Queue(const Queue &rhs) {}
 };
 
 #endif // QUEUE_H
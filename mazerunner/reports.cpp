@@ -334,7 +334,7 @@ void print_maze_plain() {
     printNorthWalls(row);
     for (int col = 0; col < 16; col++) {
       unsigned char cell = static_cast<unsigned char>(row + 16 * col);
-      if (is_exit(cell, WEST)) {
+      if (not is_wall(cell, WEST)) {
         Serial.print(("    "));
       } else {
         Serial.print(("|   "));
@@ -354,12 +354,16 @@ void print_maze_with_costs() {
     printNorthWalls(row);
     for (int col = 0; col < 16; col++) {
       unsigned char cell = static_cast<unsigned char>(row + 16 * col);
-      if (is_exit(cell, WEST)) {
+      if (not is_wall(cell, WEST)) {
         Serial.print(' ');
       } else {
         Serial.print('|');
       }
-      print_justified(cost[cell], 3);
+      if (cost[cell] == MAX_COST) {
+        Serial.print(F("  -"));
+      } else {
+        print_justified(cost[cell], 3);
+      }
     }
     Serial.println('|');
   }
@@ -372,7 +376,7 @@ static char dirChars[] = "^>v<*";
 
 void print_maze_with_directions() {
   Serial.println();
-  flood_maze(maze_goal());
+  flood_maze_goal();
   for (int row = 15; row >= 0; row--) {
     printNorthWalls(row);
     for (int col = 0; col < 16; col++) {
@@ -383,7 +387,7 @@ void print_maze_with_directions() {
         Serial.print(' ');
       }
       unsigned char direction = direction_to_smallest(cell, NORTH);
-      if (cell == maze_goal()) {
+      if (is_goal(cell)) {
         direction = 4;
       }
       Serial.print(' ');
@@ -0,0 +1,162 @@
+/*
+ * File: scurve.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:32:24 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:40:01 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// profile.h includes this file at its end when USE_SCURVE_PROFILES is set
+// so it has to come first.
+#include "profile.h"
+
+#ifndef SCURVE_H
+#define SCURVE_H
+
+#if USE_SCURVE_PROFILES && USE_FIXED_POINT_CONTROL
+#error "S-curve profiles only work with floating point control"
+#endif
+
+/***
+ * An S-curve profile takes the same parameters as a Profile and follows
+ * the same phases but the acceleration is never changed in a single step.
+ * Instead it ramps up and down at no more than the jerk limit so there is
+ * no sudden change in the force at the wheels when a phase changes. That
+ * makes it much less likely that the wheels will slip and so the peak
+ * acceleration can be higher.
+ *
+ * Each tick, the acceleration heads for the largest value that can still
+ * be brought back to zero, at the jerk limit, just as the target speed is
+ * reached. The braking distance allows for first bringing any acceleration
+ * to zero and for the jerk limited ramps at each end of the braking.
+ *
+ * The profile gets its acceleration back from zero if its speed is changed
+ * by anything other than update().
+ */
+class SCurveProfile : public BasicProfile<float> {
+  public:
+  explicit SCurveProfile(float jerk) : m_jerk(jerk) {}
+
+  void set_jerk(float jerk) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      m_jerk = jerk;
+    }
+  }
+
+  float get_braking_distance() {
+    return braking_distance(fabsf(m_speed), m_sign * m_acc_now);
+  }
+
+  // update is called from within systick and should be safe from interrupts
+  void update() {
+    if (m_state == CS_IDLE) {
+      return;
+    }
+    if (m_speed != m_last_speed) {
+      m_acc_now = 0;
+    }
+    float remaining = fabsf(m_final_position) - fabsf(m_position);
+    if (m_state == CS_ACCELERATING) {
+      // the braking distance grows quickly while the acceleration is still
+      // ramping up so look one tick ahead in case that will be too late
+      float a = m_sign * m_acc_now;
+      if (a > 0) {
+        a = min(a + m_jerk * LOOP_INTERVAL, m_acceleration);
+      }
+      float v = fabsf(m_speed) + a * LOOP_INTERVAL;
+      if (remaining - v * LOOP_INTERVAL < braking_distance(v, a)) {
+        m_state = CS_BRAKING;
+        if (m_final_speed == 0) {
+          m_target_speed = m_sign * 5.0f;
+        } else {
+          m_target_speed = m_final_speed;
+        };
+      }
+    }
+    // head for the acceleration that will just level off at the target speed
+    float dv = m_target_speed - m_speed;
+    float wanted = sqrtf(2.0f * m_jerk * fabsf(dv));
+    if (wanted > m_acceleration) {
+      wanted = m_acceleration;
+    }
+    if (dv < 0) {
+      wanted = -wanted;
+    }
+    float delta_a = m_jerk * LOOP_INTERVAL;
+    if (m_acc_now < wanted) {
+      m_acc_now = min(m_acc_now + delta_a, wanted);
+    } else {
+      m_acc_now = max(m_acc_now - delta_a, wanted);
+    }
+    m_speed += m_acc_now * LOOP_INTERVAL;
+    // never go past the target speed
+    if ((dv >= 0 && m_speed >= m_target_speed) || (dv <= 0 && m_speed <= m_target_speed)) {
+      m_speed = m_target_speed;
+      m_acc_now = 0;
+    }
+    m_last_speed = m_speed;
+    // increment the position
+    m_position += m_speed * LOOP_INTERVAL;
+    if (m_state != CS_FINISHED && remaining < 0.125) {
+      m_state = CS_FINISHED;
+      m_target_speed = m_final_speed;
+    }
+  }
+
+  private:
+  /***
+   * The distance needed to get down to the final speed from speed v with
+   * acceleration a, where a is positive if the speed is still rising.
+   */
+  float braking_distance(float v, float a) {
+    float vf = fabsf(m_final_speed);
+    float distance = 0;
+    if (a > 0) {
+      // the acceleration has to come down to zero first
+      float t = a / m_jerk;
+      distance = v * t + a * t * t / 3.0f;
+      v += 0.5f * a * t;
+    }
+    float dv = v - vf;
+    if (dv > 0) {
+      float t;
+      if (dv * m_jerk > m_acceleration * m_acceleration) {
+        t = dv / m_acceleration + m_acceleration / m_jerk;
+      } else {
+        t = 2.0f * sqrtf(dv / m_jerk);
+      }
+      distance += 0.5f * (v + vf) * t;
+    }
+    return distance;
+  }
+
+  float m_jerk;
+  float m_acc_now = 0;
+  float m_last_speed = 0;
+};
+
+#endif
@@ -31,8 +31,12 @@
  */
 
 #include "sensors.h"
+#include "control.h"
 #include "digitalWriteFast.h"
+#include "pose.h"
+#include "profile.h"
 #include "settings.h"
+#include "timing.h"
 #include <Arduino.h>
 #include <util/atomic.h>
 #include <wiring_private.h>
@@ -61,10 +65,21 @@ bool g_steering_enabled;
 volatile float g_cross_track_error;
 volatile float g_steering_adjustment;
 
+/*** wall edge variables ***/
+volatile float g_left_falling_edge;
+volatile float g_left_rising_edge;
+volatile float g_right_falling_edge;
+volatile float g_right_rising_edge;
+volatile uint8_t g_edge_corrections;
+
 //***************************************************************************//
 /***  Local variables ***/
-static float last_steering_error = 0;
+static control_t last_steering_error = 0;
+static volatile SteeringMode s_steering_mode = STEER_ORTHOGONAL;
 static volatile bool s_sensors_enabled = false;
+static volatile bool s_edge_correction_enabled = false;
+static bool s_left_wall_high = false;
+static bool s_right_wall_high = false;
 static volatile int adc[6];
 static volatile int battery_adc_reading;
 static volatile int switches_adc_reading;
@@ -129,13 +144,10 @@ int get_switches() {
  * @param error calculated from wall sensors, Negative if too far right
  * @return steering adjustment in degrees
  */
-float calculate_steering_adjustment(float error) {
+control_t calculate_steering_adjustment(control_t error) {
   // always calculate the adjustment for testing. It may not get used.
-  float pTerm = settings.steering_KP * error;
-  float dTerm = settings.steering_KD * (error - last_steering_error);
-  float adjustment = (pTerm + dTerm) * LOOP_INTERVAL;
-  // TODO: are these limits appropriate, or even needed?
-  adjustment = constrain(adjustment, -STEERING_ADJUST_LIMIT, STEERING_ADJUST_LIMIT);
+  // TODO: are the limits appropriate, or even needed?
+  control_t adjustment = get_steering_adjustment(error, last_steering_error, control_t(settings.steering_KP), control_t(settings.steering_KD));
   last_steering_error = error;
   return adjustment;
 }
@@ -154,6 +166,16 @@ void disable_steering() {
   g_steering_enabled = false;
 }
 
+/**
+ * The motion queue sets the mode at the start of each straight so that
+ * there is no need to call this during a speed run.
+ *
+ * @brief choose how the cross-track error is worked out
+ */
+void set_steering_mode(SteeringMode mode) {
+  s_steering_mode = mode;
+}
+
 //***************************************************************************//
 
 void enable_sensors() {
@@ -178,7 +200,7 @@ void update_battery_voltage() {
  * @brief update the global wall sensor values.
  * @return robot cross-track-error. Too far left is negative.
  */
-float update_wall_sensors() {
+control_t update_wall_sensors() {
   if (not s_sensors_enabled) {
     return 0;
   }
@@ -192,9 +214,9 @@ float update_wall_sensors() {
   g_left_wall_sensor_raw = adc[2];
 
   // normalise to a nominal value of 100
-  g_right_wall_sensor = (int)(g_right_wall_sensor_raw * settings.right_adjust);
-  g_front_wall_sensor = (int)(g_front_wall_sensor_raw * settings.front_adjust);
-  g_left_wall_sensor = (int)(g_left_wall_sensor_raw * settings.left_adjust);
+  g_right_wall_sensor = get_normalised_sensor(g_right_wall_sensor_raw, control_t(settings.right_adjust));
+  g_front_wall_sensor = get_normalised_sensor(g_front_wall_sensor_raw, control_t(settings.front_adjust));
+  g_left_wall_sensor = get_normalised_sensor(g_left_wall_sensor_raw, control_t(settings.left_adjust));
 
   // set the wall detection flags
   g_left_wall_present = g_left_wall_sensor > settings.left_threshold;
@@ -202,15 +224,28 @@ float update_wall_sensors() {
   g_front_wall_present = g_front_wall_sensor > settings.front_threshold;
 
   // calculate the alignment errors - too far left is negative
-  float error = 0;
-  float right_error = settings.right_nominal - g_right_wall_sensor;
-  float left_error = settings.left_nominal - g_left_wall_sensor;
+  // the sensor values are all integers so the errors are too
+  int error = 0;
+  if (s_steering_mode == STEER_DIAGONAL) {
+    // There are no walls alongside a diagonal. The side sensors only see the
+    // posts and wall ends that go past on each side and a reading above the
+    // threshold means the robot is too close to one of them.
+    if (g_left_wall_sensor > LEFT_DIAGONAL_THRESHOLD) {
+      error -= g_left_wall_sensor - LEFT_DIAGONAL_THRESHOLD;
+    }
+    if (g_right_wall_sensor > RIGHT_DIAGONAL_THRESHOLD) {
+      error += g_right_wall_sensor - RIGHT_DIAGONAL_THRESHOLD;
+    }
+    return error;
+  }
+  int right_error = settings.right_nominal - g_right_wall_sensor;
+  int left_error = settings.left_nominal - g_left_wall_sensor;
   if (g_left_wall_present && g_right_wall_present) {
     error = left_error - right_error;
   } else if (g_left_wall_present) {
-    error = 2.0 * left_error;
+    error = 2 * left_error;
   } else if (g_right_wall_present) {
-    error = -2.0 * right_error;
+    error = -2 * right_error;
   }
   // the side sensors are not reliable close to a wall ahead.
   // TODO: The magic number 100 may need adjusting
@@ -220,6 +255,118 @@ float update_wall_sensors() {
   return error;
 }
 
+//***************************************************************************//
+/*********************************** Wall edges *****************************/
+
+/***
+ * The edge detectors start from the current readings so that a wall that
+ * was already there does not look like a new edge.
+ */
+void enable_edge_correction() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    s_left_wall_high = g_left_wall_sensor > settings.left_nominal / 2;
+    s_right_wall_high = g_right_wall_sensor > settings.right_nominal / 2;
+    s_edge_correction_enabled = true;
+  }
+}
+
+void disable_edge_correction() {
+  s_edge_correction_enabled = false;
+}
+
+/***
+ * The hysteresis stops noise around the threshold looking like a string
+ * of edges.
+ *
+ * @brief return true if the sensor has just crossed its edge threshold
+ */
+static bool crossed_edge_threshold(bool &high, int value, int threshold) {
+  if (high and value < threshold - EDGE_HYSTERESIS) {
+    high = false;
+    return true;
+  }
+  if (not high and value > threshold + EDGE_HYSTERESIS) {
+    high = true;
+    return true;
+  }
+  return false;
+}
+
+/***
+ * @brief add the error for an edge to the total if it is close enough to where it should be
+ */
+static void add_edge_error(float expected, float position, float &total, uint8_t &count) {
+  float error = expected - position;
+  if (error > HALF_CELL) {
+    error -= FULL_CELL;
+  } else if (error < -HALF_CELL) {
+    error += FULL_CELL;
+  }
+  if (fabsf(error) < EDGE_WINDOW) {
+    total += error;
+    count++;
+  }
+}
+
+/***
+ * Watches the side sensors for the places where a wall ends or starts.
+ * Those are at known distances from a cell boundary so they show how far
+ * the robot really is along the cell. The robot position from the pose is
+ * recorded for each edge and, when edge correction is enabled, the error
+ * is taken out of both the forward profile and the pose while the robot
+ * keeps moving. That stops the odometry error building up over a long
+ * straight.
+ *
+ * Edges are not used on a diagonal or when the robot is turned away from
+ * its heading because the sensors then see the posts at other places.
+ *
+ * Note: Runs in the systick interrupt. DO NOT call this directly.
+ * @brief look for wall edges and correct the forward position from them
+ */
+void update_wall_edges() {
+  if (not s_sensors_enabled) {
+    return;
+  }
+  bool left_edge = crossed_edge_threshold(s_left_wall_high, g_left_wall_sensor, settings.left_nominal / 2);
+  bool right_edge = crossed_edge_threshold(s_right_wall_high, g_right_wall_sensor, settings.right_nominal / 2);
+  if (not(left_edge or right_edge)) {
+    return;
+  }
+  // there are only a few edges in each cell so the float sums are rare
+  uint8_t heading = nearest_heading(robot_pose().theta);
+  CellOffset offset = robot_cell_offset(heading);
+  float position = offset.forward + HALF_CELL;
+  float total = 0;
+  uint8_t count = 0;
+  if (left_edge) {
+    if (s_left_wall_high) {
+      g_left_rising_edge = position;
+      add_edge_error(LEFT_RISING_EDGE, position, total, count);
+    } else {
+      g_left_falling_edge = position;
+      add_edge_error(LEFT_FALLING_EDGE, position, total, count);
+    }
+  }
+  if (right_edge) {
+    if (s_right_wall_high) {
+      g_right_rising_edge = position;
+      add_edge_error(RIGHT_RISING_EDGE, position, total, count);
+    } else {
+      g_right_falling_edge = position;
+      add_edge_error(RIGHT_FALLING_EDGE, position, total, count);
+    }
+  }
+#if WALL_EDGE_CORRECTION
+  bool usable = s_steering_mode == STEER_ORTHOGONAL and fabsf(offset.angle) < EDGE_ANGLE_LIMIT;
+  if (s_edge_correction_enabled and usable and count > 0) {
+    float error = total / count;
+    forward.adjust_position(error);
+    adjust_pose_forward(heading, offset.forward + error);
+    g_edge_corrections++;
+  }
+#endif
+}
+
 //***************************************************************************//
 
 /***
@@ -259,10 +406,19 @@ static int get_adc_result() {
 
 static uint8_t sensor_phase = 0;
 
-void start_sensor_cycle() {
-  sensor_phase = 0;     // sync up the start of the sensor sequence
+/***
+ * The battery and function switch channels are only needed by the slow
+ * systick tasks. Without them, the sequence starts at the first wall sensor.
+ */
+void start_sensor_cycle(bool include_slow_channels) {
   bitSet(ADCSRA, ADIE); // enable the ADC interrupt
-  start_adc(0);         // begin a conversion to get things started
+  if (include_slow_channels) {
+    sensor_phase = 0; // sync up the start of the sensor sequence
+    start_adc(0);     // begin a conversion to get things started
+  } else {
+    sensor_phase = 3;
+    start_adc(RIGHT_WALL_SENSOR);
+  }
 }
 
 /** @brief Sample all the sensor channels with and without the emitter on
@@ -295,6 +451,7 @@ void start_sensor_cycle() {
  * will need to be changes here.
  */
 ISR(ADC_vect) {
+  uint8_t start = timing_start();
   // digitalWriteFast(13, 1);
   switch (sensor_phase) {
     case 0:
@@ -372,4 +529,5 @@ ISR(ADC_vect) {
   }
   sensor_phase++;
   // digitalWriteFast(13, 0);
+  timing_stop(TIME_ADC_ISR, start);
 }
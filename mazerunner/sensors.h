@@ -33,6 +33,7 @@
 #ifndef SENSORS_H
 #define SENSORS_H
 
+#include "fixed.h"
 #include <Arduino.h>
 #include <util/atomic.h>
 //***************************************************************************//
@@ -56,10 +57,23 @@ extern volatile bool g_front_wall_present;
 extern volatile bool g_right_wall_present;
 
 /*** steering variables ***/
+enum SteeringMode : uint8_t {
+  STEER_ORTHOGONAL, // centred between the walls either side
+  STEER_DIAGONAL,   // kept away from the posts either side of a diagonal
+};
+
 extern bool g_steering_enabled;
 extern volatile float g_cross_track_error;
 extern volatile float g_steering_adjustment;
 
+/*** wall edge variables ***/
+// where the last edge of each kind was seen, in mm past the cell boundary behind
+extern volatile float g_left_falling_edge;
+extern volatile float g_left_rising_edge;
+extern volatile float g_right_falling_edge;
+extern volatile float g_right_rising_edge;
+extern volatile uint8_t g_edge_corrections;
+
 inline int get_left_sensor() {
   int value;
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
@@ -90,14 +104,19 @@ void enable_sensors();
 void disable_sensors();
 
 void update_battery_voltage();
-float update_wall_sensors();
+control_t update_wall_sensors();
 
-void start_sensor_cycle();
+void start_sensor_cycle(bool include_slow_channels);
 
 void reset_steering();
 void enable_steering();
 void disable_steering();
-float calculate_steering_adjustment(float error);
+void set_steering_mode(SteeringMode mode);
+control_t calculate_steering_adjustment(control_t error);
+
+void enable_edge_correction();
+void disable_edge_correction();
+void update_wall_edges();
 
 int get_switches();
 
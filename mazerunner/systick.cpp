@@ -32,11 +32,29 @@
 
 #include "systick.h"
 #include "encoders.h"
+#include "motion.h"
 #include "motors.h"
+#include "pose.h"
 #include "profile.h"
 #include "sensors.h"
+#include "timing.h"
 #include <Arduino.h>
 
+volatile uint16_t g_systick_count;
+
+static_assert(SYSTICK_CLOCK % LOOP_FREQUENCY == 0, "LOOP_FREQUENCY must divide the Timer 2 clock exactly");
+static_assert(SYSTICK_COUNTS >= 2 && SYSTICK_COUNTS <= 256, "LOOP_FREQUENCY is out of range for Timer 2");
+
+/***
+ * The slow rate group runs once every SLOW_TASK_DIVIDER ticks. The slow ADC
+ * channels are sampled at the end of the tick before so the readings are
+ * fresh. The counter starts so that happens on the very first tick. Until
+ * then the battery scale is zero and the motors get no drive.
+ */
+const uint16_t SLOW_TASK_DIVIDER = LOOP_FREQUENCY / SLOW_TASK_FREQUENCY;
+static_assert(SLOW_TASK_DIVIDER >= 1 && SLOW_TASK_DIVIDER <= 255, "SLOW_TASK_FREQUENCY is out of range");
+static uint8_t s_slow_task_counter = (uint8_t)(SLOW_TASK_DIVIDER - 2);
+
 void setup_systick() {
   bitClear(TCCR2A, WGM20);
   bitSet(TCCR2A, WGM21);
@@ -45,17 +63,22 @@ void setup_systick() {
   bitSet(TCCR2B, CS22);
   bitClear(TCCR2B, CS21);
   bitSet(TCCR2B, CS20);
-  OCR2A = 249; // (16000000/128/500)-1 => 500Hz
+  OCR2A = SYSTICK_COUNTS - 1; // (16000000/128/500)-1 => 500Hz by default
   bitSet(TIMSK2, OCIE2A);
+  reset_timing();
 }
 
 /***
- * This is the SYSTICK ISR. It runs at 500Hz by default.
+ * This is the SYSTICK ISR. It runs at LOOP_FREQUENCY, 500Hz by default.
  *
- * All the time-critical control functions happen in here.
+ * All the time-critical control functions happen in here. The tasks are in
+ * two rate groups. The fast group runs every tick. The slow group, which is
+ * the battery monitor and the battery and switch ADC channels, only runs
+ * every SLOW_TASK_DIVIDER ticks.
  *
  * interrupts are enabled at the start of the ISR so that encoder
- * counts are not lost.
+ * counts are not lost. The tick count is updated first, with interrupts
+ * still off, so that the encoder edge timestamps are always consistent.
  *
  * The last thing it does is to start the sensor reads so that they
  * will be ready to use next time around.
@@ -71,19 +94,46 @@ void setup_systick() {
  * 
  * Most of the load is due to that overhead. While the profile generates actual 
  * motion, there is an additional load.
+ *
+ * Those figures are from before the pose, the motion queue and the wall
+ * edges were added. Test 30 reports the worst case with them all running.
  * 
  * 
  */
-ISR(TIMER2_COMPA_vect, ISR_NOBLOCK) {
+ISR(TIMER2_COMPA_vect) {
+  g_systick_count++;
+  sei();
   // TODO: make sure all variables are interrupt-safe if they are used outside IRQs
+  record_systick_entry();
+  uint8_t systick_start = timing_start();
+  uint8_t stage_start = systick_start;
   // grab the encoder values first because they will continue to change
   update_encoders();
-  update_battery_voltage();
+  stage_start = timing_lap(TIME_ENCODERS, stage_start);
+  update_pose();
+  stage_start = timing_lap(TIME_POSE, stage_start);
+  s_slow_task_counter++;
+  if (s_slow_task_counter == SLOW_TASK_DIVIDER) {
+    s_slow_task_counter = 0;
+    update_battery_voltage();
+  }
+  stage_start = timing_lap(TIME_BATTERY, stage_start);
   forward.update();
   rotation.update();
-  g_cross_track_error = update_wall_sensors();
-  g_steering_adjustment = calculate_steering_adjustment(g_cross_track_error);
-  update_motor_controllers(g_steering_adjustment);
-  start_sensor_cycle();
+  stage_start = timing_lap(TIME_PROFILES, stage_start);
+  update_motion();
+  stage_start = timing_lap(TIME_MOTION, stage_start);
+  control_t cross_track_error = update_wall_sensors();
+  control_t steering_adjustment = calculate_steering_adjustment(cross_track_error);
+  update_wall_edges();
+  stage_start = timing_lap(TIME_SENSORS, stage_start);
+  update_motor_controllers(steering_adjustment);
+  // these are kept as floats for logging
+  g_cross_track_error = (float)cross_track_error;
+  g_steering_adjustment = (float)steering_adjustment;
+  timing_stop(TIME_CONTROLLERS, stage_start);
+  timing_stop(TIME_SYSTICK, systick_start);
+  record_systick_exit();
+  start_sensor_cycle(s_slow_task_counter == SLOW_TASK_DIVIDER - 1);
   // NOTE: no code should follow this line;
-}
+}
@@ -33,6 +33,39 @@
 #ifndef SYSTICK_H
 #define SYSTICK_H
 
+#include "config.h"
+#include <Arduino.h>
+
+// Timer 2 counts at F_CPU/128 and systick runs every SYSTICK_COUNTS counts
+const uint32_t SYSTICK_CLOCK = F_CPU / 128;
+const uint16_t SYSTICK_COUNTS = SYSTICK_CLOCK / LOOP_FREQUENCY;
+
+// incremented at the very start of every systick, before interrupts are enabled
+extern volatile uint16_t g_systick_count;
+
 void setup_systick();
 
+/***
+ * The time is in counts of Timer 2 (8us) and wraps every 524ms. It is only
+ * meant for measuring short intervals such as the time between encoder
+ * edges.
+ *
+ * If the tick has started but systick has not yet run, because interrupts
+ * are off, the compare flag is still set and the count has gone back to a
+ * small value. That is allowed for in the same way as micros() allows for
+ * a pending Timer 0 overflow.
+ *
+ * Call with interrupts disabled.
+ *
+ * @brief get a timestamp from the systick timer
+ */
+inline uint16_t systick_time() {
+  uint8_t counts = TCNT2;
+  uint16_t ticks = g_systick_count;
+  if (bitRead(TIFR2, OCF2A) && counts < SYSTICK_COUNTS / 2) {
+    ticks++;
+  }
+  return ticks * SYSTICK_COUNTS + counts;
+}
+
 #endif
\ No newline at end of file
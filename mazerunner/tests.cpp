@@ -31,13 +31,22 @@
  */
 
 #include "tests.h"
+#include "control.h"
+#include "digitalWriteFast.h"
 #include "encoders.h"
+#include "estimate.h"
+#include "maze.h"
 #include "motion.h"
 #include "motors.h"
 #include "mouse.h"
+#include "path.h"
+#include "pose.h"
 #include "profile.h"
 #include "reports.h"
 #include "sensors.h"
+#include "stopwatch.h"
+#include "systick.h"
+#include "timing.h"
 
 //***************************************************************************//
 
@@ -94,7 +103,7 @@ void test_calibrate_encoders() {
  *
  * @brief Exercise the motor controllers for tuning of KP and KD
  */
-void test_controller_tuning(Profile &profile) {
+void test_controller_tuning(MotionProfile &profile) {
   reset_drive_system();
   uint32_t duration = 2000;       // milliseconds
   uint32_t period = duration / 2; // 2 cycles
@@ -449,7 +458,16 @@ void test_sensor_spin_calibrate() {
  *
  * Start with the robot backed up to a wall.
  * Runs forward for 150mm and records the robot position when the trailing
- * edge of the adjacent wall(s) is found.
+ * edge of the adjacent wall(s) is found. If there is no wall beside the
+ * start cell but there is one beside the next cell, the leading edge of
+ * that wall is found instead.
+ *
+ * The edges come from the same detector that corrects the robot position
+ * in systick, with the correction turned off. The positions are in mm past
+ * the cell boundary behind the robot so they can go straight into the
+ * LEFT_FALLING_EDGE and similar constants in config.h. The lines for any
+ * edges that were found are printed ready to paste in. Run it a few times
+ * with the walls placed to show each kind of edge.
  *
  * The value is only recorded to the nearest millimeter to avoid any
  * suggestion of better accuracy than that being available.
@@ -457,68 +475,944 @@ void test_sensor_spin_calibrate() {
  * Note that UKMARSBOT, with its back to a wall, has its wheels 43mm from
  * the cell boundary.
  *
- * This value can be used to permit forward error correction of the robot
- * position while exploring.
- *
  * @brief find sensor wall edge detection positions
  */
 
+static void print_edge(const __FlashStringHelper *label, float position) {
+  Serial.print(label);
+  if (position > 0) {
+    Serial.print(int(0.5 + position));
+  } else {
+    Serial.print('-');
+  }
+}
+
+static void print_edge_constant(const __FlashStringHelper *name, float position) {
+  if (position > 0) {
+    Serial.print(F("const float "));
+    Serial.print(name);
+    Serial.print(F(" = "));
+    Serial.print(int(0.5 + position));
+    Serial.println(';');
+  }
+}
+
 void test_edge_detection() {
-  bool left_edge_found = false;
-  bool right_edge_found = false;
-  int left_edge_position = 0;
-  int right_edge_position = 0;
-  int left_max = 0;
-  int right_max = 0;
   enable_sensors();
   delay(100);
   reset_drive_system();
   enable_motor_controllers();
   disable_steering();
+  set_pose_in_cell(START, NORTH, -BACK_WALL_TO_CENTER);
+  g_left_falling_edge = 0;
+  g_left_rising_edge = 0;
+  g_right_falling_edge = 0;
+  g_right_rising_edge = 0;
   Serial.println(F("Edge positions:"));
   forward.start(FULL_CELL - 30.0, 100, 0, 1000);
   while (not forward.is_finished()) {
-    if (g_left_wall_sensor > left_max) {
-      left_max = g_left_wall_sensor;
+    delay(5);
+  }
+  print_edge(F("Left falling: "), g_left_falling_edge);
+  print_edge(F("  rising: "), g_left_rising_edge);
+  print_edge(F("  Right falling: "), g_right_falling_edge);
+  print_edge(F("  rising: "), g_right_rising_edge);
+  Serial.println();
+  print_edge_constant(F("LEFT_FALLING_EDGE"), g_left_falling_edge);
+  print_edge_constant(F("LEFT_RISING_EDGE"), g_left_rising_edge);
+  print_edge_constant(F("RIGHT_FALLING_EDGE"), g_right_falling_edge);
+  print_edge_constant(F("RIGHT_RISING_EDGE"), g_right_rising_edge);
+
+  reset_drive_system();
+  disable_sensors();
+  delay(100);
+}
+//***************************************************************************//
+/**
+ * Walk from the start to the goal of one of the sample mazes in flash as a
+ * search would. The map starts empty and, at each cell, the mouse 'sees'
+ * the real walls. The costs are kept up to date either by a full flood at
+ * every cell or by flooding once at the start and then only repairing the
+ * flood with flood_update_after_walls(), so the repairs build on each
+ * other all the way to the goal.
+ *
+ * Times include any interrupts that happen during the flood.
+ *
+ * Returns the number of cells visited. The time spent on the costs is
+ * added to time.
+ */
+static int simulated_search(const uint8_t *maze, bool repair, uint32_t &time) {
+  uint8_t location = START;
+  uint8_t heading = NORTH;
+  int steps = 0;
+  initialise_maze(emptyMaze);
+  flood_maze_goal();
+  Stopwatch stopwatch;
+  while (not is_goal(location) && steps < 256) {
+    uint8_t new_walls = pgm_read_byte(maze + location) & ~walls[location] & 0x0F;
+    for (uint8_t direction = 0; direction < 4; direction++) {
+      if (new_walls & (1 << direction)) {
+        set_wall_present(location, direction);
+      }
     }
+    mark_cell_visited(location);
+    stopwatch.start();
+    if (repair) {
+      flood_update_after_walls(location, new_walls);
+    } else {
+      flood_maze_goal();
+    }
+    stopwatch.stop();
+    time += stopwatch.elapsed_time();
+    heading = direction_to_smallest(location, heading);
+    location = neighbour(location, heading);
+    steps++;
+  }
+  return steps;
+}
 
-    if (g_right_wall_sensor > right_max) {
-      right_max = g_right_wall_sensor;
+/**
+ * Time the simulated search with full floods and with the repair. The
+ * costs left by the repairs are then checked, cell by cell, against a
+ * fresh flood of the final map.
+ *
+ * Every reachable cost in these mazes is well under 255 so a byte per cell
+ * is enough for the copy and it saves 256 bytes of stack. Unreachable
+ * cells are stored as 255.
+ */
+static void flood_benchmark(const uint8_t *maze, const __FlashStringHelper *name) {
+  uint32_t full_time = 0;
+  uint32_t repair_time = 0;
+  simulated_search(maze, false, full_time);
+  int steps = simulated_search(maze, true, repair_time);
+  uint8_t repaired[256];
+  for (int i = 0; i < 256; i++) {
+    repaired[i] = (cost[i] < 255) ? cost[i] : 255;
+  }
+  flood_maze_goal();
+  int errors = 0;
+  for (int i = 0; i < 256; i++) {
+    uint8_t fresh = (cost[i] < 255) ? cost[i] : 255;
+    if (fresh != repaired[i]) {
+      errors++;
     }
+  }
+  Serial.print(name);
+  Serial.print(F(" cells: "));
+  Serial.print(steps);
+  Serial.print(F("  full (us): "));
+  Serial.print(full_time);
+  Serial.print(F("  repair (us): "));
+  Serial.print(repair_time);
+  Serial.print(F("  wrong costs: "));
+  Serial.println(errors);
+}
 
-    if (not left_edge_found) {
-      if (g_left_wall_sensor < left_max / 2) {
-        left_edge_position = int(0.5 + forward.position());
-        left_edge_found = true;
-      }
+/** TEST 22
+ *
+ * Compares the time taken to keep the costs up to date during a search using
+ * a full flood at every cell and using the incremental repair. Each search
+ * goes from the start to the goal in a simulated maze so the robot does not
+ * move. The repaired costs at the goal are checked against a full flood so
+ * any error that builds up over the whole search will show.
+ *
+ * NOTE: the maze map is cleared by this test.
+ *
+ * @brief compare full and incremental floods during a simulated search
+ */
+void test_flood_benchmark() {
+  flood_benchmark(japan2007, F("japan2007"));
+  flood_benchmark(emptyMaze, F("emptyMaze"));
+  initialise_maze(emptyMaze);
+}
+
+//***************************************************************************//
+// from the avr-libc malloc implementation
+extern char *__brkval;
+extern char __heap_start;
+
+/**
+ * The free memory is the gap between the top of the heap and the stack.
+ */
+static int free_ram() {
+  char top_of_stack;
+  char *heap_end = __brkval ? __brkval : &__heap_start;
+  return &top_of_stack - heap_end;
+}
+
+#ifndef HOST_BUILD
+const uint8_t STACK_PAINT = 0xA5;
+
+/**
+ * Fill the free memory with a known pattern, leaving a little room for
+ * this function, so that the deepest the stack reaches afterwards can be
+ * found by looking for the first byte that has changed.
+ */
+static void paint_free_ram() {
+  char top_of_stack;
+  char *p = __brkval ? __brkval : &__heap_start;
+  while (p < &top_of_stack - 16) {
+    *p++ = STACK_PAINT;
+  }
+}
+
+/**
+ * The free memory that was never touched since paint_free_ram().
+ */
+static int untouched_free_ram() {
+  char *heap_end = __brkval ? __brkval : &__heap_start;
+  char *p = heap_end;
+  while (*p == STACK_PAINT) {
+    p++;
+  }
+  return p - heap_end;
+}
+#endif
+
+static uint32_t flood_time(bool (*flood)(uint8_t, uint8_t, FloodStop)) {
+  const int repeats = 100;
+  Stopwatch stopwatch;
+  for (int i = 0; i < repeats; i++) {
+    flood(maze_goal(), maze_goal_size(), nullptr);
+  }
+  stopwatch.stop();
+  return stopwatch.elapsed_time() / repeats;
+}
+
+static void print_flood_time(const __FlashStringHelper *name, uint32_t microseconds) {
+  Serial.print(name);
+  Serial.print(microseconds);
+  Serial.print(F("  cycles: "));
+  Serial.print(microseconds * (F_CPU / 1000000L));
+}
+
+#if FLOOD_BITBOARD
+/**
+ * Count the cells where the two floods disagree, in both flood modes. No
+ * cost in a 16x16 maze is more than 255 so a byte is enough to hold it
+ * with MAX_COST stored as 255.
+ */
+static int bitboard_differences() {
+  int differences = 0;
+  for (int mode = OPTIMISTIC; mode <= PESSIMISTIC; mode++) {
+    set_flood_mode((FloodMode)mode);
+    flood_maze_queue(maze_goal(), maze_goal_size());
+    uint8_t queue_cost[256];
+    for (int i = 0; i < 256; i++) {
+      queue_cost[i] = (cost[i] < 255) ? cost[i] : 255;
     }
-    if (not right_edge_found) {
-      if (g_right_wall_sensor < right_max / 2) {
-        right_edge_position = int(0.5 + forward.position());
-        right_edge_found = true;
+    flood_maze_bitboard(maze_goal(), maze_goal_size());
+    for (int i = 0; i < 256; i++) {
+      uint8_t bitboard_cost = (cost[i] < 255) ? cost[i] : 255;
+      if (bitboard_cost != queue_cost[i]) {
+        differences++;
       }
     }
-    delay(5);
-  }
-  Serial.print(F("Left: "));
-  if (left_edge_found) {
-    Serial.print(BACK_WALL_TO_CENTER + left_edge_position);
-  } else {
-    Serial.print('-');
   }
+  set_flood_mode(OPTIMISTIC);
+  return differences;
+}
+#endif
 
-  Serial.print(F("  Right: "));
-  if (right_edge_found) {
-    Serial.print(BACK_WALL_TO_CENTER + right_edge_position);
-  } else {
-    Serial.print('-');
+static void flood_timing(const uint8_t *maze, const __FlashStringHelper *name) {
+  initialise_maze(maze);
+  Serial.print(name);
+  print_flood_time(F(" queue (us): "), flood_time(flood_maze_queue));
+#if FLOOD_BITBOARD
+  print_flood_time(F("  bitboard (us): "), flood_time(flood_maze_bitboard));
+  Serial.print(F("  differences: "));
+  Serial.print(bitboard_differences());
+#endif
+  Serial.println();
+}
+
+/** TEST 23
+ *
+ * Time the flood on the sample mazes. Each flood is repeated many times to
+ * get a reasonable average from the 4us resolution of micros(). The cycle
+ * count is calculated from the time so it includes any interrupts.
+ *
+ * When FLOOD_BITBOARD is set in maze.h, the bitboard flood is timed as well
+ * and its costs are checked against the queue flood in both flood modes.
+ * The queue flood uses 128 bytes less RAM so the bitboard flood is only
+ * worth having if it is clearly faster here.
+ *
+ * The free memory is reported as well so that any use of the heap will show
+ * up. The flood does not use the heap so this should not change.
+ *
+ * next_cell_to_explore() is the deepest user of the stack in the search
+ * since it calls the flood several times from inside its own frame. The
+ * free memory is painted before it is called on an unexplored maze and the
+ * memory that was never touched is reported as the least free RAM. That
+ * is meaningless in a host build so it is left out there.
+ *
+ * NOTE: the maze map is cleared by this test.
+ *
+ * @brief report flood timing and free memory
+ */
+void test_flood_timing() {
+  Serial.print(F("free RAM: "));
+  Serial.println(free_ram());
+  flood_timing(japan2007, F("japan2007"));
+  flood_timing(emptyMaze, F("emptyMaze"));
+  Serial.print(F("free RAM: "));
+  Serial.println(free_ram());
+  initialise_maze(emptyMaze);
+#ifndef HOST_BUILD
+  paint_free_ram();
+  next_cell_to_explore(START, START, maze_goal(), maze_goal_size());
+  Serial.print(F("least free RAM in next_cell_to_explore: "));
+  Serial.println(untouched_free_ram());
+#endif
+}
+
+//***************************************************************************//
+static void print_path_summary(const __FlashStringHelper *name) {
+  int halfCells = 0;
+  int turns = 0;
+  int bytes = 0;
+  for (int i = 0; path_op(path[i]) != PATH_STOP; i++) {
+    if (path_op(path[i]) == PATH_STRAIGHT) {
+      halfCells += path_count(path[i]);
+    } else {
+      turns++;
+    }
+    bytes++;
+  }
+  // the text form must convert back into exactly the same path
+  char text[PATH_LENGTH + 32];
+  uint8_t copy[PATH_LENGTH];
+  bool same = path_to_text(path, text, sizeof(text)) && path_from_text(text, copy, PATH_LENGTH);
+  for (int i = 0; same && i <= bytes; i++) {
+    same = copy[i] == path[i];
+  }
+  Serial.print(name);
+  Serial.print(F(" cells: "));
+  Serial.print(halfCells / 2);
+  Serial.print(F("  turns: "));
+  Serial.print(turns);
+  Serial.print(F("  bytes: "));
+  Serial.print(bytes + 1);
+  if (not same) {
+    Serial.print(F("  text DIFFERENT"));
   }
   Serial.println();
+  dorothy.print_path();
+  uint8_t compiled[PATH_LENGTH];
+  bool diagonals = path_compile_diagonals(path, compiled, PATH_LENGTH);
+  if (diagonals) {
+    print_path_codes(compiled);
+  }
+  Serial.print(F("  run times  spin: "));
+  Serial.print(estimate_run_time(path, false, SPEEDMAX_STRAIGHT, SEARCH_ACCELERATION), 2);
+  Serial.print(F("  smooth: "));
+  Serial.print(estimate_run_time(path, true, SPEEDMAX_STRAIGHT, SEARCH_ACCELERATION), 2);
+  if (diagonals) {
+    Serial.print(F("  diagonal: "));
+    Serial.print(estimate_run_time(compiled, true, SPEEDMAX_STRAIGHT, SEARCH_ACCELERATION), 2);
+  }
+  Serial.println();
+}
+
+/** TEST 24
+ *
+ * Make paths through the japan2007 sample maze from a manhattan flood and
+ * from the weighted flood used for speed runs so that the routes can be
+ * compared. The weighted route may be longer but should have fewer turns.
+ * Each path is also shown compiled for a diagonal speed run, followed by
+ * the estimated times for speed runs with each kind of turn.
+ *
+ * NOTE: the maze map is cleared by this test.
+ *
+ * @brief compare shortest and time-weighted paths
+ */
+void test_speed_run_path() {
+  initialise_maze(japan2007);
+  for (int i = 0; i < 256; i++) {
+    mark_cell_visited(i);
+  }
+  flood_maze_goal();
+  dorothy.make_path(START);
+  print_path_summary(F("manhattan"));
+  flood_for_speed_run(maze_goal());
+  dorothy.make_path(START);
+  print_path_summary(F("weighted "));
+  initialise_maze(emptyMaze);
+}
+
+//***************************************************************************//
+#if USE_FIXED_POINT_CONTROL || defined(HOST_BUILD)
+static void print_difference(const __FlashStringHelper *name, float difference, float limit) {
+  Serial.print(name);
+  Serial.print(F(" max difference: "));
+  Serial.print(difference, 5);
+  Serial.println(difference <= limit ? F("  OK") : F("  FAIL"));
+}
+
+/**
+ * The time for each multiply includes the loop and the volatile loads and
+ * stores so it is a little more than the multiply on its own. That is the
+ * same for the float and the fixed point loops.
+ */
+static void print_multiply_time(const __FlashStringHelper *name, uint32_t microseconds, int repeats) {
+  Serial.print(name);
+  Serial.print(F(" (us): "));
+  Serial.print((float)microseconds / repeats, 2);
+  Serial.print(F("  cycles: "));
+  Serial.println(microseconds * (F_CPU / 1000000L) / repeats);
+}
+
+static float compare_profiles(float distance, float top_speed, float final_speed, float acceleration) {
+  BasicProfile<float> float_profile;
+  BasicProfile<Fixed> fixed_profile;
+  float_profile.start(distance, top_speed, final_speed, acceleration);
+  fixed_profile.start(distance, top_speed, final_speed, acceleration);
+  float difference = 0;
+  for (int i = 0; i < 5000 && not(float_profile.is_finished() && fixed_profile.is_finished()); i++) {
+    float_profile.update();
+    fixed_profile.update();
+    difference = max(difference, fabsf(float_profile.position() - fixed_profile.position()));
+  }
+  return difference;
+}
+
+/** TEST 25
+ *
+ * Runs the float and the fixed point versions of the systick sums side by
+ * side on the same inputs and reports the largest difference between them.
+ * It does not move the robot so it will also run in a host build.
+ *
+ * Both versions of every sum, and both kinds of profile, take up a lot of
+ * flash so the test is only built in when USE_FIXED_POINT_CONTROL is set
+ * or for a host build with HOST_BUILD defined.
+ *
+ * Profile positions are in mm or degrees, the controller and feedforward
+ * outputs are in volts and the PWM and sensor values are integers that
+ * may round differently.
+ *
+ * Last of all, a float and a fixed point multiply are timed, along with
+ * per_tick() for each, since those are what most of the systick sums are
+ * made of.
+ *
+ * @brief compare the fixed point control sums with the float versions
+ */
+void test_fixed_point_control() {
+  float difference = 0;
+  difference = max(difference, compare_profiles(1000, 2000, 0, 3000));
+  difference = max(difference, compare_profiles(-180, 300, 100, 1000));
+  difference = max(difference, compare_profiles(90, 700, 0, 8000));
+  difference = max(difference, compare_profiles(-360, 1000, 0, 2000));
+  print_difference(F("profiles   "), difference, 0.01);
+
+  difference = 0;
+  for (int left = -20; left <= 20; left++) {
+    for (int right = -20; right <= 20; right++) {
+      float float_fwd, float_rot;
+      Fixed fixed_fwd, fixed_rot;
+      get_wheel_increments((float)left, (float)right, float_fwd, float_rot);
+      get_wheel_increments(Fixed(left), Fixed(right), fixed_fwd, fixed_rot);
+      difference = max(difference, fabsf(float_fwd - (float)fixed_fwd));
+      difference = max(difference, fabsf(float_rot - (float)fixed_rot));
+    }
+  }
+  print_difference(F("encoders   "), difference, 0.001);
+
+  difference = 0;
+  for (float error = -5; error <= 5; error += 0.125) {
+    float old_error = error * 0.75f;
+    float output = get_pd_output(error, old_error, settings.fwdKP, settings.fwdKD);
+    Fixed fixed_output = get_pd_output(Fixed(error), Fixed(old_error), Fixed(settings.fwdKP), Fixed(settings.fwdKD));
+    difference = max(difference, fabsf(output - (float)fixed_output));
+    float fwd = error;
+    float rot = 2 * error;
+    float left, right;
+    Fixed fixed_left, fixed_right;
+    get_feedforward(fwd, rot, left, right);
+    get_feedforward(Fixed(fwd), Fixed(rot), fixed_left, fixed_right);
+    difference = max(difference, fabsf(left - (float)fixed_left));
+    difference = max(difference, fabsf(right - (float)fixed_right));
+  }
+  print_difference(F("controllers"), difference, 0.001);
+
+  difference = 0;
+  for (float error = -200; error <= 200; error += 1.5) {
+    float old_error = error - 10;
+    float adjustment = get_steering_adjustment(error, old_error, settings.steering_KP, settings.steering_KD);
+    Fixed fixed_adjustment = get_steering_adjustment(Fixed(error), Fixed(old_error), Fixed(settings.steering_KP), Fixed(settings.steering_KD));
+    difference = max(difference, fabsf(adjustment - (float)fixed_adjustment));
+  }
+  print_difference(F("steering   "), difference, 0.001);
+
+  difference = 0;
+  for (int raw = 0; raw < 1024; raw++) {
+    int value = get_normalised_sensor(raw, settings.front_adjust);
+    int fixed_value = get_normalised_sensor(raw, Fixed(settings.front_adjust));
+    difference = max(difference, (float)abs(value - fixed_value));
+  }
+  for (float volts = -7; volts <= 7; volts += 0.01f) {
+    float scale = 255.0f / 7.4f;
+    int pwm = get_motor_pwm(volts, scale);
+    int fixed_pwm = get_motor_pwm(Fixed(volts), Fixed(scale));
+    difference = max(difference, (float)abs(pwm - fixed_pwm));
+  }
+  print_difference(F("pwm/sensors"), difference, 1);
+
+  const int repeats = 1000;
+  volatile float float_a = 123.456f;
+  volatile float float_b = -0.789f;
+  volatile float float_result;
+  Stopwatch stopwatch;
+  for (int i = 0; i < repeats; i++) {
+    float_result = float_a * float_b;
+  }
+  stopwatch.stop();
+  print_multiply_time(F("float multiply"), stopwatch.elapsed_time(), repeats);
+  volatile int32_t raw_a = Fixed(123.456f).raw();
+  volatile int32_t raw_b = Fixed(-0.789f).raw();
+  volatile int32_t raw_result;
+  stopwatch.start();
+  for (int i = 0; i < repeats; i++) {
+    raw_result = (Fixed::from_raw(raw_a) * Fixed::from_raw(raw_b)).raw();
+  }
+  stopwatch.stop();
+  print_multiply_time(F("fixed multiply"), stopwatch.elapsed_time(), repeats);
+  stopwatch.start();
+  for (int i = 0; i < repeats; i++) {
+    float_result = per_tick(float_a);
+  }
+  stopwatch.stop();
+  print_multiply_time(F("float per_tick"), stopwatch.elapsed_time(), repeats);
+  stopwatch.start();
+  for (int i = 0; i < repeats; i++) {
+    raw_result = per_tick(Fixed::from_raw(raw_a)).raw();
+  }
+  stopwatch.stop();
+  print_multiply_time(F("fixed per_tick"), stopwatch.elapsed_time(), repeats);
+}
+#endif // USE_FIXED_POINT_CONTROL || defined(HOST_BUILD)
+
+//***************************************************************************//
+/***
+ * This is the decoder that the encoder interrupts used before the lookup
+ * table. It is kept here as the reference.
+ */
+static int8_t reference_decode(bool &oldA, bool &oldB, bool clk, bool b) {
+  bool newB = b;
+  bool newA = clk ^ newB;
+  int delta = (oldA ^ newB) - (newA ^ oldB);
+  oldA = newA;
+  oldB = newB;
+  return delta;
+}
+
+/** TEST 26
+ *
+ * Feeds pin sequences through the old and new quadrature decoders and
+ * checks that they agree on every step. Each byte has the clock pin level
+ * in bit 1 and the B pin level in bit 0. The sequences are rotation each
+ * way, jitter on one edge and some missed edges.
+ *
+ * Then each decoder is run over the sequences many times to compare the
+ * time they take. After that, the whole body of the old and new left
+ * encoder interrupts is timed. That covers the pin reads, the decoding and
+ * the counter update but not the interrupt entry and exit, which have not
+ * changed. Build with ISR_TIMING and ENCODER_EDGE_TIMING at 0 to match the
+ * default firmware.
+ *
+ * @brief check the table-driven quadrature decoder against the old one
+ */
+void test_quadrature_decoder() {
+  const uint8_t pins[] = {
+      0, 2, 1, 3, 0, 2, 1, 3, 0, 2, 1, 3, 0, // 12 steps one way
+      3, 1, 2, 0, 3, 1, 2, 0, 3, 1, 2, 0,    // 12 steps back
+      2, 0, 2, 0, 2, 0,                      // jitter on one edge
+      1, 0, 3, 2, 1, 0, 2, 3,                // missed edges
+  };
+  const int count = sizeof(pins);
+  bool oldA = false;
+  bool oldB = false;
+  uint8_t state = 0;
+  int reference_total = 0;
+  int table_total = 0;
+  int mismatches = 0;
+  for (int i = 0; i < count; i++) {
+    int8_t reference = reference_decode(oldA, oldB, pins[i] >> 1, pins[i] & 1);
+    int8_t table = decode_quadrature(state, pins[i] >> 1, pins[i] & 1);
+    reference_total += reference;
+    table_total += table;
+    if (reference != table) {
+      mismatches++;
+    }
+  }
+  Serial.print(F("steps: "));
+  Serial.print(count);
+  Serial.print(F("  totals: "));
+  Serial.print(reference_total);
+  Serial.print(' ');
+  Serial.print(table_total);
+  Serial.print(F("  mismatches: "));
+  Serial.println(mismatches);
+
+  const int repeats = 100;
+  volatile int sink = 0;
+  Stopwatch stopwatch;
+  for (int r = 0; r < repeats; r++) {
+    for (int i = 0; i < count; i++) {
+      sink += reference_decode(oldA, oldB, pins[i] >> 1, pins[i] & 1);
+    }
+  }
+  stopwatch.stop();
+  float reference_time = (float)stopwatch.elapsed_time() / (repeats * count);
+  stopwatch.start();
+  for (int r = 0; r < repeats; r++) {
+    for (int i = 0; i < count; i++) {
+      sink += decode_quadrature(state, pins[i] >> 1, pins[i] & 1);
+    }
+  }
+  stopwatch.stop();
+  float table_time = (float)stopwatch.elapsed_time() / (repeats * count);
+  Serial.print(F("us per step  old: "));
+  Serial.print(reference_time, 2);
+  Serial.print(F("  table: "));
+  Serial.println(table_time, 2);
+
+  const int isr_repeats = 1000;
+  volatile int counter = 0;
+  stopwatch.start();
+  for (int r = 0; r < isr_repeats; r++) {
+    bool newB = digitalReadFast(ENCODER_LEFT_B);
+    bool clk = digitalReadFast(ENCODER_LEFT_CLK);
+    counter += ENCODER_LEFT_POLARITY * reference_decode(oldA, oldB, clk, newB);
+  }
+  stopwatch.stop();
+  float old_isr_time = (float)stopwatch.elapsed_time() / isr_repeats;
+  stopwatch.start();
+  for (int r = 0; r < isr_repeats; r++) {
+    uint8_t pins = PIND;
+    counter += ENCODER_LEFT_POLARITY * decode_quadrature(state, (pins >> ENCODER_LEFT_CLK) & 1, (pins >> ENCODER_LEFT_B) & 1);
+  }
+  stopwatch.stop();
+  float new_isr_time = (float)stopwatch.elapsed_time() / isr_repeats;
+  Serial.print(F("us per ISR body  old: "));
+  Serial.print(old_isr_time, 2);
+  Serial.print(F("  new: "));
+  Serial.println(new_isr_time, 2);
+}
+
+//***************************************************************************//
+/** TEST 27
+ *
+ * First checks the sine table used by the pose estimator against sin()
+ * over a few turns each way and times them both.
+ *
+ * Then put the robot in the centre of the start cell, facing north, and
+ * push it around the maze by hand. The pose and the offset from the centre
+ * of the current cell, seen facing north, are printed ten times a second.
+ * Check them against where the robot really is.
+ *
+ * Press the function button when done.
+ *
+ * @brief check the pose estimator
+ */
+void test_pose_estimator() {
+  float max_error = 0;
+  for (float angle = -720; angle < 720; angle += 0.37f) {
+    float error = fabsf(sin_deg(angle) - sin(radians(angle)));
+    max_error = max(max_error, error);
+    error = fabsf(cos_deg(angle) - cos(radians(angle)));
+    max_error = max(max_error, error);
+  }
+  Serial.print(F("sine table max error: "));
+  Serial.println(max_error, 6);
+
+  const int repeats = 100;
+  volatile float sink = 0;
+  Stopwatch stopwatch;
+  for (int i = 0; i < repeats; i++) {
+    sink += sin(radians(i * 3.7f));
+  }
+  stopwatch.stop();
+  float library_time = (float)stopwatch.elapsed_time() / repeats;
+  stopwatch.start();
+  for (int i = 0; i < repeats; i++) {
+    sink += sin_deg(i * 3.7f);
+  }
+  stopwatch.stop();
+  float table_time = (float)stopwatch.elapsed_time() / repeats;
+  Serial.print(F("us per call  sin(): "));
+  Serial.print(library_time, 1);
+  Serial.print(F("  sin_deg(): "));
+  Serial.println(table_time, 1);
 
   reset_drive_system();
-  disable_sensors();
+  set_pose_in_cell(START, NORTH, 0);
+  Serial.println(F("     x      y  theta  cell   fwd   lat  angle"));
+  while (not button_pressed()) {
+    Pose pose = robot_pose();
+    CellOffset offset = robot_cell_offset(NORTH);
+    print_justified((int)pose.x, 6);
+    print_justified((int)pose.y, 7);
+    print_justified((int)pose.theta, 7);
+    Serial.print(F("    "));
+    print_hex_2(offset.cell);
+    print_justified((int)offset.forward, 6);
+    print_justified((int)offset.lateral, 6);
+    print_justified((int)offset.angle, 7);
+    Serial.println();
+    delay(100);
+  }
+  wait_for_button_release();
+}
+
+//***************************************************************************//
+/** TEST 28
+ *
+ * Creeps forward 40mm at 20mm/s, which is well under one encoder count
+ * per tick. Every tenth tick it prints the profile speed, the speed from
+ * the whole counts and the speed in the feedback, all in mm/s. At the end
+ * it prints the mean change in each speed from one tick to the next and,
+ * once the robot has settled, how far the robot is from the profile
+ * position.
+ *
+ * With ENCODER_EDGE_TIMING at 0 the two speeds are the same. Run it with
+ * each setting to see what the edge timing does for slow moves and stops.
+ *
+ * @brief compare count and edge timing speeds at creep speed
+ */
+void test_creep_speed() {
+  if (not ENCODER_EDGE_TIMING) {
+    Serial.println(F("ENCODER_EDGE_TIMING is off. Feedback is from the counts."));
+  }
+  reset_drive_system();
+  enable_motor_controllers();
+  Serial.println(F("profile counted feedback"));
+  float counted_change = 0;
+  float feedback_change = 0;
+  float last_counted = 0;
+  float last_feedback = 0;
+  uint16_t ticks = 0;
+  uint16_t last_tick = g_systick_count;
+  forward.start(40, 20, 0, 200);
+  while (not forward.is_finished()) {
+    if (g_systick_count == last_tick) {
+      continue;
+    }
+    last_tick = g_systick_count;
+    float counted = robot_counted_fwd_increment() * LOOP_FREQUENCY;
+    float feedback = (float)robot_fwd_increment() * LOOP_FREQUENCY;
+    counted_change += fabsf(counted - last_counted);
+    feedback_change += fabsf(feedback - last_feedback);
+    last_counted = counted;
+    last_feedback = feedback;
+    ticks++;
+    if (ticks % 10 == 0) {
+      print_justified((int)forward.speed(), 7);
+      print_justified((int)counted, 8);
+      print_justified((int)feedback, 9);
+      Serial.println();
+    }
+  }
+  delay(500);
+  Serial.print(F("mean change per tick  counted: "));
+  Serial.print(counted_change / ticks, 2);
+  Serial.print(F("  feedback: "));
+  Serial.println(feedback_change / ticks, 2);
+  Serial.print(F("final position error (mm): "));
+  Serial.println(forward.position() - robot_position(), 2);
+  reset_drive_system();
+}
+
+//***************************************************************************//
+/** TEST 29
+ *
+ * Times Profile::update() while a profile is accelerating, which is when
+ * it compares its position with the brake position from start(). Then
+ * times the braking distance check that update() used to do every tick
+ * instead. The sum of the two is the time update() took before. The
+ * profile is long and gentle so it is still accelerating at the end.
+ *
+ * adjust_position() has to work the brake position out again so that is
+ * timed as well. It is not called from systick.
+ *
+ * The times include any interrupts so they are averaged over many calls.
+ * It does not move the robot.
+ *
+ * @brief time the profile update with and without the braking check
+ */
+void test_profile_update_timing() {
+  const int repeats = 1000;
+  const float distance = 100000;
+  Profile profile;
+  profile.reset();
+  profile.start(distance, 3000, 0, 100);
+  Stopwatch stopwatch;
+  for (int i = 0; i < repeats; i++) {
+    profile.update();
+  }
+  stopwatch.stop();
+  float update_time = (float)stopwatch.elapsed_time() / repeats;
+  volatile int sink = 0;
+  stopwatch.start();
+  for (int i = 0; i < repeats; i++) {
+    float remaining = distance - fabsf(profile.position());
+    sink += remaining < profile.get_braking_distance();
+  }
+  stopwatch.stop();
+  float check_time = (float)stopwatch.elapsed_time() / repeats;
+  stopwatch.start();
+  for (int i = 0; i < repeats; i++) {
+    profile.adjust_position(0);
+  }
+  stopwatch.stop();
+  float adjust_time = (float)stopwatch.elapsed_time() / repeats;
+  Serial.print(F("us per update  now: "));
+  Serial.print(update_time, 2);
+  Serial.print(F("  with braking check: "));
+  Serial.println(update_time + check_time, 2);
+  Serial.print(F("us per adjust_position: "));
+  Serial.println(adjust_time, 2);
+}
+
+//***************************************************************************//
+/** TEST 30
+ *
+ * Systick now updates the pose, starts queued motion commands and looks
+ * for wall edges as well as running the profiles and controllers. This
+ * test finds the longest systick with all of that going on. It needs
+ * ISR_TIMING set to 1 in config.h.
+ *
+ * Put the robot at the start with its back to the wall and a wall on at
+ * least one side. It runs forward for a cell with the sensors, steering
+ * and edge correction on, makes a smooth 90 degree left turn so that both
+ * profiles are busy at once and then stops. The full timing table follows
+ * the worst case.
+ *
+ * Check that the worst case leaves plenty of the tick free before moving
+ * any more work into systick.
+ *
+ * @brief report the longest systick with all the tasks running
+ */
+void test_systick_worst_case() {
+  if (not ISR_TIMING) {
+    Serial.println(F("Set ISR_TIMING to 1 in config.h to run this test"));
+    return;
+  }
+  enable_sensors();
   delay(100);
+  reset_drive_system();
+  enable_motor_controllers();
+  set_pose_in_cell(START, NORTH, -BACK_WALL_TO_CENTER);
+  enable_edge_correction();
+  reset_timing();
+  float turn_speed = 300;
+  motion_enqueue(MOVE_FORWARD, BACK_WALL_TO_CENTER + FULL_CELL - 20, DEFAULT_SEARCH_SPEED, turn_speed, SEARCH_ACCELERATION);
+  motion_enqueue(MOVE_ROTATE, 90, 280, 0, 2000);
+  motion_enqueue(MOVE_FORWARD, HALF_CELL, turn_speed, 0, SEARCH_ACCELERATION);
+  while (not motion_is_finished()) {
+    delay(5);
+  }
+  float worst = timing_max_us(TIME_SYSTICK);
+  reset_drive_system();
+  disable_sensors();
+  Serial.print(F("worst systick (us): "));
+  Serial.print(worst, 0);
+  Serial.print(F(" of "));
+  Serial.print(LOOP_INTERVAL * 1.0e6f, 0);
+  Serial.print(F("  ("));
+  Serial.print(100.0f * worst / (LOOP_INTERVAL * 1.0e6f), 1);
+  Serial.println(F("%)"));
+  report_timing();
+}
+
+//***************************************************************************//
+/** TEST 31
+ *
+ * Checks the speed run turn table in motion.cpp without moving the robot.
+ * Each right turn is run through a Profile, one tick at a time, while the
+ * robot carries on at the turn speed. The path of the robot is added up to
+ * find where the turn ends, relative to where it starts, and its heading.
+ *
+ * The turn should end at the exit reference point less the run-out, having
+ * started at the entry reference point plus the run-in. The references are
+ * the cell centres for straights and the points half a diagonal step from
+ * the corners for diagonals, as counted in a compiled path. The vectors
+ * between them, in mm forward and to the left of the entry heading, are
+ * in the table below.
+ *
+ * Each line gives the expected and actual end of the turn, the error in mm
+ * and the heading error in degrees.
+ * Any turn that ends more than 5mm or 1 degree out is marked as BAD. The
+ * table needs working out again after a change to SPEED_RUN_TURN_ALPHA or
+ * to the turn speeds.
+ *
+ * @brief check the speed run turns end where the path expects
+ */
+struct TurnReference {
+  uint8_t code;
+  float forward; // mm from the entry reference to the exit reference
+  float left;    //
+};
+
+static const TurnReference turn_references[] = {
+    {PATH_RIGHT, 0, 0},
+    {PATH_SS180, 0, -FULL_CELL},
+    {PATH_SD45, -HALF_CELL / 2, -HALF_CELL / 2},
+    {PATH_SD135, -HALF_CELL / 2, -3 * HALF_CELL / 2},
+    {PATH_DS45, 0, DIAGONAL_STEP / 2},
+    {PATH_DS135, DIAGONAL_STEP, -DIAGONAL_STEP / 2},
+    {PATH_DD90, DIAGONAL_STEP / 2, -DIAGONAL_STEP / 2},
+};
+
+void test_turn_geometry() {
+  int bad = 0;
+  Serial.println(F("turn  speed  expected x,y  actual x,y  error  heading"));
+  for (const TurnReference &ref : turn_references) {
+    TurnParameters turn;
+    get_turn_parameters(ref.code, turn);
+    float speed = path_turn_speed(ref.code);
+    Profile profile;
+    profile.reset();
+    profile.start(turn.angle, turn.omega, 0, SPEED_RUN_TURN_ALPHA);
+    // the rotation still slows to a stop after the profile has finished
+    float x = 0;
+    float y = 0;
+    float theta = 0;
+    for (int ticks = 0; ticks < 2 * LOOP_FREQUENCY; ticks++) {
+      if (profile.is_finished() and profile.speed() == 0) {
+        break;
+      }
+      profile.update();
+      float heading = profile.position();
+      float direction = 0.5f * (theta + heading);
+      x += speed * LOOP_INTERVAL * cos_deg(direction);
+      y += speed * LOOP_INTERVAL * sin_deg(direction);
+      theta = heading;
+    }
+    float exit_angle = turn.angle;
+    float expected_x = ref.forward - turn.run_in - turn.run_out * cos_deg(exit_angle);
+    float expected_y = ref.left - turn.run_out * sin_deg(exit_angle);
+    float error = hypotf(x - expected_x, y - expected_y);
+    float heading_error = theta - exit_angle;
+    print_path_code(ref.code);
+    print_justified((int)speed, 7);
+    print_justified((int)expected_x, 7);
+    print_justified((int)expected_y, 5);
+    print_justified((int)x, 7);
+    print_justified((int)y, 5);
+    Serial.print(' ');
+    Serial.print(error, 1);
+    Serial.print(' ');
+    Serial.print(heading_error, 2);
+    if (error > 5 or fabsf(heading_error) > 1) {
+      Serial.print(F("  BAD"));
+      bad++;
+    }
+    Serial.println();
+  }
+  Serial.print(F("bad turns: "));
+  Serial.println(bad);
 }
+
 //***************************************************************************//
 /** Test runner
  *
@@ -590,6 +1484,40 @@ void run_test(int test) {
     case (21):
       test_sensor_spin_calibrate();
       break;
+    case (22):
+      test_flood_benchmark();
+      break;
+    case (23):
+      test_flood_timing();
+      break;
+    case (24):
+      test_speed_run_path();
+      break;
+    case (25):
+#if USE_FIXED_POINT_CONTROL || defined(HOST_BUILD)
+      test_fixed_point_control();
+#else
+      Serial.println(F("Only built in with USE_FIXED_POINT_CONTROL"));
+#endif
+      break;
+    case (26):
+      test_quadrature_decoder();
+      break;
+    case (27):
+      test_pose_estimator();
+      break;
+    case (28):
+      test_creep_speed();
+      break;
+    case (29):
+      test_profile_update_timing();
+      break;
+    case (30):
+      test_systick_worst_case();
+      break;
+    case (31):
+      test_turn_geometry();
+      break;
     default:
       disable_sensors();
       reset_drive_system();
@@ -0,0 +1,174 @@
+/*
+ * File: timing.cpp
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:41:42 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 3:54:09 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "timing.h"
+#include <util/atomic.h>
+
+struct TimingStats {
+  uint8_t min;
+  uint8_t max;
+  uint32_t count;
+  uint32_t total;
+};
+
+static TimingStats s_stats[TIME_CHANNEL_COUNT];
+static volatile bool s_in_systick = false;
+static volatile uint16_t s_overruns = 0;
+
+// Timer 2 is clocked at F_CPU/128
+const float US_PER_COUNT = 128.0e6 / F_CPU;
+
+void reset_timing() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    for (int i = 0; i < TIME_CHANNEL_COUNT; i++) {
+      s_stats[i].min = 255;
+      s_stats[i].max = 0;
+      s_stats[i].count = 0;
+      s_stats[i].total = 0;
+    }
+    s_overruns = 0;
+  }
+}
+
+/***
+ * Called from interrupts only. A section that runs past the end of a tick
+ * sees TCNT2 go back to zero so the elapsed time is worked out modulo the
+ * length of a tick.
+ */
+void record_timing(TimingChannel channel, uint8_t start) {
+  int16_t elapsed = (int16_t)TCNT2 - start;
+  if (elapsed < 0) {
+    elapsed += OCR2A + 1;
+  }
+  TimingStats &stats = s_stats[channel];
+  stats.min = min(stats.min, (uint8_t)elapsed);
+  stats.max = max(stats.max, (uint8_t)elapsed);
+  stats.count++;
+  stats.total += elapsed;
+}
+
+void record_systick_entry() {
+  if (ISR_TIMING && s_in_systick) {
+    s_overruns++;
+  }
+  s_in_systick = true;
+}
+
+void record_systick_exit() {
+  s_in_systick = false;
+}
+
+/***
+ * @brief the longest time recorded for a channel since the last reset, in us
+ */
+float timing_max_us(TimingChannel channel) {
+  uint8_t longest;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    longest = s_stats[channel].max;
+  }
+  return longest * US_PER_COUNT;
+}
+
+static const __FlashStringHelper *channel_name(int channel) {
+  switch (channel) {
+    case TIME_SYSTICK:
+      return F("systick    ");
+    case TIME_ENCODERS:
+      return F("  encoders ");
+    case TIME_POSE:
+      return F("  pose     ");
+    case TIME_BATTERY:
+      return F("  battery  ");
+    case TIME_PROFILES:
+      return F("  profiles ");
+    case TIME_MOTION:
+      return F("  motion   ");
+    case TIME_SENSORS:
+      return F("  sensors  ");
+    case TIME_CONTROLLERS:
+      return F("  motors   ");
+    case TIME_ADC_ISR:
+      return F("ADC ISR    ");
+    case TIME_ENCODER_ISR:
+      return F("encoder ISR");
+    default:
+      return F("?          ");
+  }
+}
+
+/***
+ * Times are in microseconds. The load is the share of all the time since
+ * the last reset used by a channel, assuming systick has been running
+ * throughout. The stats are cleared afterwards so that each report covers
+ * the time since the one before.
+ *
+ * @brief print the interrupt timing table and start again
+ */
+void report_timing() {
+  if (not ISR_TIMING) {
+    Serial.println(F("ISR timing is turned off in config.h"));
+    return;
+  }
+  TimingStats stats[TIME_CHANNEL_COUNT];
+  uint16_t overruns;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memcpy(stats, s_stats, sizeof(stats));
+    overruns = s_overruns;
+  }
+  reset_timing();
+  uint32_t ticks = stats[TIME_SYSTICK].count;
+  Serial.print(F("ticks: "));
+  Serial.print(ticks);
+  Serial.print(F("  overruns: "));
+  Serial.println(overruns);
+  if (ticks == 0) {
+    return;
+  }
+  Serial.println(F("channel     calls min mean max load%"));
+  for (int i = 0; i < TIME_CHANNEL_COUNT; i++) {
+    uint32_t count = stats[i].count;
+    Serial.print(channel_name(i));
+    Serial.print(' ');
+    Serial.print(count);
+    if (count > 0) {
+      Serial.print(' ');
+      Serial.print(stats[i].min * US_PER_COUNT, 0);
+      Serial.print(' ');
+      Serial.print(stats[i].total * US_PER_COUNT / count, 1);
+      Serial.print(' ');
+      Serial.print(stats[i].max * US_PER_COUNT, 0);
+      Serial.print(' ');
+      Serial.print(100.0f * stats[i].total / (ticks * (OCR2A + 1.0f)), 1);
+    }
+    Serial.println();
+  }
+}
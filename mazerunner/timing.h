@@ -0,0 +1,104 @@
+/*
+ * File: timing.h
+ * Project: mazerunner
+ * File Created: Friday, 16th October 2026 3:41:42 pm
+ * Author: Peter Harrison
+ * -----
+ * Last Modified: Friday, 16th October 2026 4:05:34 pm
+ * Modified By: Peter Harrison
+ * -----
+ * MIT License
+ *
+ * Copyright (c) 2026 Peter Harrison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "config.h"
+#include <Arduino.h>
+
+/***
+ * The interrupt timing keeps the shortest, longest and mean time taken
+ * by each stage of systick and by the other interrupts. It uses TCNT2,
+ * the systick timer, as the clock. That counts up from zero at the start
+ * of every tick so no extra hardware is needed. The resolution is one
+ * count of Timer 2, which is 8us. Very short interrupts like the encoders
+ * mostly read as zero or one count but, because they happen at random
+ * times, the mean is still about right.
+ *
+ * systick runs with interrupts enabled so its stages include any encoder
+ * and ADC interrupts that happened while they were running.
+ *
+ * A systick that starts before the previous one has finished is counted
+ * as an overrun.
+ *
+ * Set ISR_TIMING to 1 in config.h to build this in. It is off by default.
+ */
+enum TimingChannel : uint8_t {
+  TIME_SYSTICK,     // all of systick
+  TIME_ENCODERS,    // systick stages
+  TIME_POSE,        //
+  TIME_BATTERY,     //
+  TIME_PROFILES,    //
+  TIME_MOTION,      //
+  TIME_SENSORS,     // wall sensors and steering
+  TIME_CONTROLLERS, //
+  TIME_ADC_ISR,     // other interrupts
+  TIME_ENCODER_ISR, //
+  TIME_CHANNEL_COUNT,
+};
+
+void record_timing(TimingChannel channel, uint8_t start);
+void record_systick_entry();
+void record_systick_exit();
+
+/***
+ * @brief get a timestamp for the start of a timed section
+ */
+inline uint8_t timing_start() {
+  return ISR_TIMING ? TCNT2 : 0;
+}
+
+/***
+ * @brief record the time since start for a channel
+ */
+inline void timing_stop(TimingChannel channel, uint8_t start) {
+  if (ISR_TIMING) {
+    record_timing(channel, start);
+  }
+}
+
+/***
+ * Lets consecutive stages be timed with one timestamp each.
+ *
+ * @brief record the time since start and return a new start
+ */
+inline uint8_t timing_lap(TimingChannel channel, uint8_t start) {
+  timing_stop(channel, start);
+  return timing_start();
+}
+
+void reset_timing();
+void report_timing();
+float timing_max_us(TimingChannel channel);
+
+#endif
@@ -37,6 +37,7 @@
 #include "sensors.h"
 #include "settings.h"
 #include "tests.h"
+#include "timing.h"
 #include "user.h"
 #include <Arduino.h>
 
@@ -286,6 +287,7 @@ void cli_help() {
   Serial.println(F("X   : reset maze"));
   Serial.println(F("R   : display maze with directions"));
   Serial.println(F("S   : show sensor readings"));
+  Serial.println(F("I   : show and clear interrupt timing"));
   Serial.println(F("T n : Run Test n"));
   Serial.println(F("       0 = ---"));
   Serial.println(F("       1 = Report sensor calibration"));
@@ -305,6 +307,16 @@ void cli_help() {
   Serial.println(F("      15 = ---"));
   Serial.println(F("      20 = test edge detection"));
   Serial.println(F("      21 = sensor spin calibration"));
+  Serial.println(F("      22 = flood benchmark"));
+  Serial.println(F("      23 = flood timing"));
+  Serial.println(F("      24 = speed run path"));
+  Serial.println(F("      25 = fixed point control"));
+  Serial.println(F("      26 = quadrature decoder"));
+  Serial.println(F("      27 = pose estimator"));
+  Serial.println(F("      28 = creep speed feedback"));
+  Serial.println(F("      29 = profile update timing"));
+  Serial.println(F("      30 = systick worst case"));
+  Serial.println(F("      31 = speed run turn geometry"));
   Serial.println(F("U n : Run user function n"));
   Serial.println(F("       0 = ---"));
   Serial.println(F("       1 = log front sensor "));
@@ -357,6 +369,9 @@ void cli_interpret(const Args &args) {
       case 'U':
         cli_run_user(args);
         break;
+      case 'I':
+        report_timing();
+        break;
       default:
         break;
     }